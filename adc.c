@@ -7,6 +7,8 @@
  *  Author: Visakhan
  */
 
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "adc.h"
 
 
@@ -63,6 +65,32 @@ uint16_t adc_samp(void)
     return ADC;
 }
 
+/* Do one ADC sample asleep, woken by the ADC interrupt, and return 10-bit result
+ *
+ *	sleep_mode : SLEEP_MODE_ADC (conversion with CPU and I/O clocks halted)
+ *				 or SLEEP_MODE_IDLE
+ *
+ *	Other interrupts may wake up first, sleep goes on till the conversion
+ *	is done. Interrupts must be enabled */
+uint16_t adc_samp_sleep(uint8_t sleep_mode)
+{
+	set_sleep_mode(sleep_mode);
+	ADCSRA |= (1 << ADIE)|(1 << ADSC);
+	sleep_enable();
+	cli();
+	while(ADCSRA & (1 << ADSC)) {
+		sei();  /* Takes effect after the next instruction: no interrupt before sleep */
+		sleep_cpu();
+		cli();
+	}
+	sei();
+	sleep_disable();
+	ADCSRA &= ~(1 << ADIE);  /* ADIF cleared by the interrupt */
+
+	/* Read results */
+	return ADC;
+}
+
 /* Do one ADC sample and return 8-bit result ADCH (Polled mode)
  * Note: It is necessary to call ADC_LEFT_ADJUST() to before
  * using this function for meaningful ADC output value */
@@ -79,3 +107,7 @@ uint8_t adc_samp_8(void)
 
 }
 
+/* Wakes up from adc_samp_sleep()
+ * Budget: ISR_BUDGET_ADC cycles */
+EMPTY_INTERRUPT(ADC_vect);
+
@@ -66,6 +66,7 @@ void adc_select_channel(uint8_t adc_ch);
 void adc_select_vref(uint8_t vref);
 uint16_t adc_samp(void);
 uint8_t adc_samp_8(void);
+uint16_t adc_samp_sleep(uint8_t sleep_mode);
 
 
 #endif /* ADC_H_ */
@@ -4,9 +4,18 @@
  *	Author 			: Visakhan C
  *	Date			: 2019-11-17
  */
- 
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
 #include <avr/io.h>
 
+/* Board revision, selected with BOARD= in Makefile: what is fitted and pin maps */
+#ifndef BOARD_REV_H
+#define BOARD_REV_H			"board_v1.h"
+#endif
+#include BOARD_REV_H
+
 /* Various pins brought out in the board
 
 	Name			Pin (ATmega8 TQFP)
@@ -19,8 +28,9 @@
 	PC5 (SCL)(ADC5)		28 (Wired to SCL of DS3231 RTC module)
 	PD2 (INT0)			32 (Wired to Button)
 	PD0 (RXD)			30 (NC)
-	PD1 (TXD)			31 (Wired to CLK of TM1637 LED Driver module)
-	PD4 				2  (Wired to DIO of TM1637 LED Driver module)
+	PD1 (TXD)			31 (Wired to DIO of TM1637 LED Driver module)
+	PD4 				2  (Wired to CLK of TM1637 LED Driver module)
+	PD5 (T1)			9  (NC. Wire to 32K of DS3231 RTC module for stopwatch)
 	PD6					10 (Wired to LED)
 	PD7 (AIN1)			11 (NC)
 	PB0 (ICP1)			12 (NC)
@@ -41,22 +51,61 @@
 #define LED_PORT			PORTD
 #define LED_DDR				DDRD
 	
+#if BOARD_HAS_BUTTON
 /* Active low button (Not present on second version - with HC-49 crystal) */
 #define BUTTON				PD2
 #define BUTTON_PORT			PORTD
 #define BUTTON_PIN			PIND
 #define BUTTON_DDR			DDRD
+#endif
 
+#if BOARD_HAS_CHRG
 /* Battery Charging indication - Active low
 (NOT WORKING(H/W BUG) - DOES NOT GO ACTIVE LOW WHEN CHARGING ***/
 #define CHRG				PC2
 #define CHRG_PORT			PORTC
 #define CHRG_PIN			PINC
 #define CHRG_DDR			DDRC
-
+#endif
+
+/* INT/SQW of DS3231 (open drain, pull-up on the module), low from an
+alarm till its flag is cleared */
+#define RTC_INT				PD3
+#define RTC_INT_PIN			PIND
+
+/* 32.768kHz clock from DS3231 (open drain) to Timer1 external clock input */
+#define SW_CLK				PD5
+#define SW_CLK_PORT			PORTD
+
+/* DS3231 bus (external pull-ups), driven as GPIO to clear a stuck bus */
+#define TWI_SDA				PC4
+#define TWI_SCL				PC5
+#define TWI_PORT			PORTC
+#define TWI_PIN				PINC
+#define TWI_DDR				DDRC
+
+/* Buzzer driver transistor - Active high. Toggled from the Timer2 compare ISR with
+sbi/cbi, so it must stay on a port in the bit-addressable I/O space */
+#define BUZZER				PC3
+#define BUZZER_PORT			PORTC
+#define BUZZER_DDR			DDRC
 
 #define BAT_ADC_CHANNEL		ADC_CHANNEL_1
+#if BOARD_HAS_LDR
 #define LDR_ADC_CHANNEL		ADC_CHANNEL_2
+#endif
+
+#define BAT_CAPACITY_MAH	1000	/* Li-ion cell fitted */
+
+/* Battery current of board parts (uA), for fuel gauge load compensation
+and energy accounting. Measured at 3.8V */
+#define I_SLEEP_UA			120		/* Power down: regulator, RTC, display driver standby */
+#define I_ACTIVE_UA			(400 + (F_CPU / 1000000UL) * 550)	/* MCU running (over sleep) */
+#define I_IDLE_UA			(150 + (F_CPU / 1000000UL) * 200)	/* MCU in Idle mode (over sleep) */
+#define I_DISP_UA			{ 6000, 9000, 15000, 34000 }		/* Display at each brightness level */
+#define I_BUZZER_UA			30000
+#define I_ADC_UA			350		/* ADC and bandgap on */
+#define I_TWI_UA			400		/* Bus pull-ups and DS3231 interface active */
 
 
 /*********************** MACROS *************************/
@@ -66,8 +115,19 @@
 #define LED_OFF()			(LED_PORT |= (1 << LED))
 #define LED_TOGGLE()		(LED_PORT ^= (1 << LED))
 
+#if BOARD_HAS_BUTTON
 #define BUTTON_INIT()		(BUTTON_PORT |= (1 << BUTTON))	/* Enable internal pullup */
 #define BUTTON_PRESSED()	((BUTTON_PIN & (1 << BUTTON)) == 0)
+#endif
+
+#define RTC_INT_ACTIVE()	((RTC_INT_PIN & (1 << RTC_INT)) == 0)
 
+#define BUZZER_INIT()		(BUZZER_DDR |= (1 << BUZZER))
+#define BUZZER_PIN_OFF()	(BUZZER_PORT &= ~(1 << BUZZER))
+
+#if BOARD_HAS_CHRG
 #define CHRG_INIT()			(CHRG_PORT |= (1 << CHRG))  /* Enable internal pullup */
 #define BAT_CHARGING()		((CHRG_PIN & (1 << CHRG)) == 0)
+#endif
+
+#endif /* BOARD_H_ */
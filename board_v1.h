@@ -0,0 +1,20 @@
+/**
+ *	File 			: board_v1.h
+ *	Description 	: Digital Clock board, first revision (with button)
+ *	Author 			: Visakhan C
+ *	Date			: 2026-10-18
+ */
+
+#ifndef BOARD_V1_H_
+#define BOARD_V1_H_
+
+/* Hardware fitted (0 leaves out its code and interrupts) */
+#define BOARD_HAS_BUTTON	1		/* Button on INT0 */
+#define BOARD_HAS_CHRG		0		/* CHRG of LTC4054 does not go low when charging (hardware bug) */
+#define BOARD_HAS_LDR		0		/* Not tested yet */
+
+/* TM1637 module. DIO shares TXD */
+#define TM1637_CLK			PD4
+#define TM1637_DIO			PD1
+
+#endif /* BOARD_V1_H_ */
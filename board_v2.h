@@ -0,0 +1,20 @@
+/**
+ *	File 			: board_v2.h
+ *	Description 	: Digital Clock board, second revision (HC-49 crystal, no button)
+ *	Author 			: Visakhan C
+ *	Date			: 2026-10-18
+ */
+
+#ifndef BOARD_V2_H_
+#define BOARD_V2_H_
+
+/* Hardware fitted (0 leaves out its code and interrupts) */
+#define BOARD_HAS_BUTTON	0		/* Set from the serial console only */
+#define BOARD_HAS_CHRG		0		/* CHRG of LTC4054 does not go low when charging (hardware bug) */
+#define BOARD_HAS_LDR		0		/* Not tested yet */
+
+/* TM1637 module. DIO shares TXD */
+#define TM1637_CLK			PD4
+#define TM1637_DIO			PD1
+
+#endif /* BOARD_V2_H_ */
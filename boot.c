@@ -0,0 +1,248 @@
+/*
+ * boot.c
+ *
+ *	Serial bootloader in the boot section (see boot.h). Built on its own
+ *	with 'make boot' and programmed once over ISP with 'make boot-program'
+ *
+ *	At reset the application runs right away, unless RXD is held low
+ *	(serial break) or there is no application (first word erased). The
+ *	application also jumps to the update entry on 'U=boot' from the console.
+ *	Once entered, it waits for commands till BOOT_TIMEOUT_S seconds pass
+ *	without a byte received, then runs the application if there is one.
+ *
+ *	Updates are driven by tools/boot_flash.py on RXD/TXD at BOOT_BAUD 8N1.
+ *	The host reads a CRC-16 of each application page and writes only the
+ *	pages that differ, each checked by CRC on the way in and read back
+ *	after writing. Page 0 (reset vector) is blanked first and written
+ *	last by the host, so an update cut short stays in the bootloader.
+ *	TXD is TM1637 DIO: the display keeps its contents (see console.c).
+ *
+ *	On the RC clocks above 1MHz, which the ATmega8 does not calibrate at
+ *	reset, OSCCAL is loaded first with the factory calibration byte built
+ *	in (BOOT_OSCCAL, see Makefile): 38400 baud and the application need it.
+ *
+ *	Polled, no interrupts. Built without C runtime (-nostartfiles): the
+ *	entry code below sets up the stack, and only locals are used since
+ *	.data and .bss are not initialized.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/io.h>
+#include <avr/boot.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <stdbool.h>
+#include "boot.h"
+
+
+#define UBRR_VALUE			((F_CPU + 4UL * BOOT_BAUD) / (8UL * BOOT_BAUD) - 1)
+#define TIMEOUT_TICKS		((uint16_t)(F_CPU / 1024UL * BOOT_TIMEOUT_S))	/* Timer1 at F_CPU/1024 */
+
+#if (F_CPU / 1024UL * BOOT_TIMEOUT_S) > 65535
+#error "BOOT_TIMEOUT_S does not fit Timer1 at this F_CPU"
+#endif
+
+#if BOOT_RC_CAL && !defined(BOOT_OSCCAL)
+#error "RC clock above 1MHz needs BOOT_OSCCAL: build with 'make boot-program'"
+#endif
+
+#define STR_(x)				#x
+#define STR(x)				STR_(x)
+
+
+void boot_main(uint8_t request) __attribute__((noreturn, used));
+
+/* Entry points at BOOT_START: reset (BOOTRST fuse programmed) at
+ * BOOT_RESET_WORD, update request from application at BOOT_REQUEST_WORD */
+__asm__ (
+	".section .vectors,\"ax\",@progbits"	"\n"
+	"	rjmp 1f"							"\n"
+	"	ldi r24, 1"							"\n"
+	"	rjmp 2f"							"\n"
+	"1:	ldi r24, 0"							"\n"
+	"2:	clr r1"								"\n"
+	"	out __SREG__, r1"					"\n"
+	"	ldi r28, lo8(" STR(RAMEND) ")"		"\n"
+	"	ldi r29, hi8(" STR(RAMEND) ")"		"\n"
+	"	out __SP_L__, r28"					"\n"
+	"	out __SP_H__, r29"					"\n"
+	"	rjmp boot_main"						"\n"
+	".text"								"\n"
+);
+
+
+static bool app_valid(void)
+{
+	return (pgm_read_word(0) != 0xFFFF);
+}
+
+
+/* Leave peripherals as after reset (Timer1 cleared for the boot time
+ * measurement of the application) and run it */
+static void __attribute__((noreturn)) run_app(void)
+{
+	UCSRB = 0;
+	UCSRA = 0;
+	TCCR1B = 0;
+	TCNT1 = 0;
+	PORTD = 0;
+	((void (*)(void))0)();
+	__builtin_unreachable();
+}
+
+
+static void tx(uint8_t c)
+{
+	while(!(UCSRA & (1 << UDRE)));
+	UDR = c;
+}
+
+
+/* Wait for a byte. Runs the application if none comes for BOOT_TIMEOUT_S */
+static uint8_t rx(void)
+{
+	while(!(UCSRA & (1 << RXC))) {
+		if(TCNT1 >= TIMEOUT_TICKS) {
+			if(app_valid()) {
+				run_app();
+			}
+			TCNT1 = 0;
+		}
+	}
+	TCNT1 = 0;
+	return UDR;
+}
+
+
+static uint16_t page_crc(uint16_t addr)
+{
+	uint16_t crc = 0;
+	uint8_t i;
+
+	for(i = 0; i < SPM_PAGESIZE; i++) {
+		crc = _crc_xmodem_update(crc, pgm_read_byte(addr + i));
+	}
+	return crc;
+}
+
+
+/* Erase, write and read back a page */
+static bool page_write(uint16_t addr, const uint8_t *buf)
+{
+	uint8_t i;
+
+	eeprom_busy_wait();  /* SPM is not allowed while EEPROM is written */
+	boot_page_erase(addr);
+	boot_spm_busy_wait();
+	for(i = 0; i < SPM_PAGESIZE; i += 2) {
+		boot_page_fill(addr + i, buf[i] | ((uint16_t)buf[i+1] << 8));
+	}
+	boot_page_write(addr);
+	boot_spm_busy_wait();
+	boot_rww_enable();
+
+	for(i = 0; i < SPM_PAGESIZE; i++) {
+		if(pgm_read_byte(addr + i) != buf[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void boot_main(uint8_t request)
+{
+	uint8_t buf[SPM_PAGESIZE];
+	uint8_t cmd, c, page = 0, i, n;
+	uint16_t crc, addr;
+	bool ok;
+
+#ifdef BOOT_OSCCAL
+	OSCCAL = BOOT_OSCCAL;
+#endif
+	PORTD = (1 << PD0);  /* Pull up RXD, so only a driven break reads low */
+	if(!request && app_valid()) {
+		__builtin_avr_delay_cycles(F_CPU / 100000UL);  /* 10us for pull up to settle */
+		if(PIND & (1 << PD0)) {
+			run_app();
+		}
+	}
+
+	UBRRH = (uint8_t)(UBRR_VALUE >> 8);
+	UBRRL = (uint8_t)UBRR_VALUE;
+	UCSRA = (1 << U2X);
+	UCSRC = (1 << URSEL)|(1 << UCSZ1)|(1 << UCSZ0);  /* 8N1 */
+	UCSRB = (1 << RXEN)|(1 << TXEN);
+	TCNT1 = 0;
+	TCCR1B = (1 << CS12)|(1 << CS10);  /* F_CPU/1024 for timeout */
+
+	while(1) {
+		cmd = rx();
+		switch(cmd) {
+		case BOOT_CMD_WRITE:
+			n = 1 + SPM_PAGESIZE;
+			break;
+		case BOOT_CMD_SYNC:
+		case BOOT_CMD_HASH:
+		case BOOT_CMD_GO:
+			n = 0;
+			break;
+		default:
+			continue;  /* Not a command (break, noise): wait for next */
+		}
+
+		crc = _crc_xmodem_update(0, cmd);
+		for(i = 0; i < n; i++) {  /* Page number, then page data */
+			c = rx();
+			crc = _crc_xmodem_update(crc, c);
+			if(i) {
+				buf[i - 1] = c;
+			}
+			else {
+				page = c;
+			}
+		}
+		crc ^= (uint16_t)rx() << 8;
+		crc ^= rx();
+		if(crc) {
+			tx(BOOT_NAK);
+			continue;
+		}
+
+		switch(cmd) {
+		case BOOT_CMD_SYNC:
+			tx(BOOT_CMD_SYNC);
+			tx(SPM_PAGESIZE);
+			tx(BOOT_APP_PAGES);
+			tx(BOOT_VERSION);
+			break;
+
+		case BOOT_CMD_HASH:
+			tx(BOOT_ACK);
+			for(addr = 0; addr < BOOT_START; addr += SPM_PAGESIZE) {
+				crc = page_crc(addr);
+				tx(crc >> 8);
+				tx(crc);
+			}
+			break;
+
+		case BOOT_CMD_WRITE:
+			ok = (page < BOOT_APP_PAGES) && page_write((uint16_t)page * SPM_PAGESIZE, buf);
+			tx(ok ? BOOT_ACK : BOOT_NAK);
+			break;
+
+		case BOOT_CMD_GO:
+			if(!app_valid()) {
+				tx(BOOT_NAK);
+				break;
+			}
+			tx(BOOT_ACK);
+			UCSRA |= (1 << TXC);  /* Cleared by writing 1 */
+			while(!(UCSRA & (1 << TXC)));
+			run_app();
+		}
+	}
+}
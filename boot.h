@@ -0,0 +1,46 @@
+/*
+ * boot.h
+ *
+ *	Serial bootloader layout and protocol, shared by the application
+ *	and the bootloader (boot.c)
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include <avr/io.h>
+#include <stdint.h>
+
+
+/* Boot section of 512 words at the end of 8K flash (BOOTSZ = 01).
+ * Application must end below it. Keep in step with BOOT_START in Makefile */
+#define BOOT_START			0x1C00
+#define BOOT_APP_PAGES		(BOOT_START / SPM_PAGESIZE)
+
+/* Entry points: reset, and update request from application (word addresses) */
+#define BOOT_RESET_WORD		(BOOT_START / 2)
+#define BOOT_REQUEST_WORD	(BOOT_START / 2 + 1)
+
+#if F_CPU >= 4000000UL
+#define BOOT_BAUD			38400
+#else
+#define BOOT_BAUD			9600
+#endif
+#define BOOT_TIMEOUT_S		5		/* Quiet time before running application */
+#define BOOT_VERSION		1
+
+/* Commands (host to clock), each followed by fixed payload and CRC-16/XMODEM
+ * (MSB first) of command and payload */
+#define BOOT_CMD_SYNC		'S'		/* Reply: 'S', page size, app pages, version */
+#define BOOT_CMD_HASH		'H'		/* Reply: 'K', CRC-16 of each app page */
+#define BOOT_CMD_WRITE		'W'		/* Page number, page data. Reply: 'K' or 'E' */
+#define BOOT_CMD_GO			'G'		/* Reply: 'K' and run application, or 'E' if none */
+
+#define BOOT_ACK			'K'
+#define BOOT_NAK			'E'
+
+
+#endif /* BOOT_H_ */
@@ -0,0 +1,245 @@
+/*
+ * calendar.c
+ *
+ *	Calendar calculations on DS3231 time
+ *
+ *	Daylight saving time (CONFIG_DST): the RTC keeps standard time and the
+ *	time shown is moved an hour ahead during DST. This year's transitions
+ *	are worked out when one is passed (or the year or time changes), and
+ *	the next one is cached as a number ordered like the time, so each
+ *	tick only compares with it.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/pgmspace.h>
+#include "config.h"
+#include "calendar.h"
+
+
+/* Days before start of each month (non leap year) */
+static const uint16_t month_days[] PROGMEM = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+/* Table for day of week calculation */
+static const uint8_t dow_table[] PROGMEM = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+
+#if CONFIG_DST
+/* Transitions: month, Sunday of the month (1-4, 5 for last), hour of standard time */
+#if CONFIG_DST == DST_EU_GMT
+#define DST_START			3, 5, 1
+#define DST_END				10, 5, 1
+#elif CONFIG_DST == DST_EU_CET
+#define DST_START			3, 5, 2
+#define DST_END				10, 5, 2
+#elif CONFIG_DST == DST_EU_EET
+#define DST_START			3, 5, 3
+#define DST_END				10, 5, 3
+#elif CONFIG_DST == DST_US
+#define DST_START			3, 2, 2
+#define DST_END				11, 1, 1
+#elif CONFIG_DST == DST_AU
+#define DST_START			10, 1, 2
+#define DST_END				4, 1, 2
+#elif CONFIG_DST == DST_NZ
+#define DST_START			9, 5, 2
+#define DST_END				4, 1, 2
+#else
+#error "Unknown CONFIG_DST rule"
+#endif
+
+static uint32_t		dst_next;		/* Next transition (dst_key()), 0 to work out again */
+static bool			dst_on;
+#endif
+
+
+static __inline__ uint8_t bcd2bin8(uint8_t bcd)
+{
+	return ((bcd >> 4)*10 + (bcd & 0x0F));
+}
+
+
+static __inline__ uint8_t bin2bcd8(uint8_t bin)
+{
+	return (((bin / 10) << 4) | (bin % 10));
+}
+
+
+/* Increment BCD value, back to first after last. Returns true on wrap */
+static bool bcd_inc(uint8_t *v, uint8_t last, uint8_t first)
+{
+	if(*v >= last) {
+		*v = first;
+		return true;
+	}
+	*v += ((*v & 0x0F) == 9) ? 7 : 1;
+	return false;
+}
+
+
+/* Days in month 1-12 of year from 2000 */
+uint8_t cal_month_len(uint8_t month, uint8_t year)
+{
+	if(2 == month) {
+		return (year & 0x3) ? 28 : 29;
+	}
+	return ((1 << month) & 0x0A50) ? 30 : 31;  /* April, June, September, November */
+}
+
+
+static void next_day(ds3231_time_t *t)
+{
+	t->day = (t->day >= 7) ? 1 : (t->day + 1);
+	if(bcd_inc(&t->date, bin2bcd8(cal_month_len(bcd2bin8(t->month), bcd2bin8(t->year))), 1) &&
+			bcd_inc(&t->month, 0x12, 1)) {
+		bcd_inc(&t->year, 0x99, 0);
+	}
+}
+
+
+/* Day of week (0 for Sunday) of a date in 2000-2099 */
+uint8_t cal_dayofweek(uint8_t date, uint8_t month, uint16_t year)
+{
+	uint16_t temp;
+
+	if (month < 3) {
+		year--;
+	}
+
+	temp = year + year/4 - year/100 + year/400 + pgm_read_byte(&dow_table[month - 1]) + date;
+	return (uint8_t)(temp % 7);
+}
+
+
+/* Seconds since 2000-01-01 00:00:00 of the (BCD) RTC time, 0 if the
+ * month is out of range (time never read) */
+uint32_t cal_seconds(const ds3231_time_t *t)
+{
+	uint8_t year = bcd2bin8(t->year);
+	uint8_t month = bcd2bin8(t->month);
+	uint16_t days;
+
+	if((month < 1) || (month > 12)) {
+		return 0;
+	}
+
+	days = (uint16_t)year * 365 + (year + 3) / 4 + pgm_read_word(&month_days[month - 1]) + bcd2bin8(t->date) - 1;
+	if((month > 2) && !(year & 0x3)) {  /* Leap year (2000-2099) */
+		days++;
+	}
+	return (((uint32_t)days * 24 + bcd2bin8(t->hour)) * 60 + bcd2bin8(t->min)) * 60 + bcd2bin8(t->sec);
+}
+
+
+/* Advance (BCD) time by one second, for time kept without the RTC */
+void cal_tick(ds3231_time_t *t)
+{
+	if(bcd_inc(&t->sec, 0x59, 0) && bcd_inc(&t->min, 0x59, 0) && bcd_inc(&t->hour, 0x23, 0)) {
+		next_day(t);
+	}
+}
+
+
+#if CONFIG_DST
+static void prev_day(ds3231_time_t *t)
+{
+	uint8_t month = bcd2bin8(t->month);
+	uint8_t year = bcd2bin8(t->year);
+
+	t->day = (t->day <= 1) ? 7 : (t->day - 1);
+	if(t->date > 1) {
+		t->date = bin2bcd8(bcd2bin8(t->date) - 1);
+		return;
+	}
+	if(month > 1) {
+		month--;
+	}
+	else {
+		month = 12;
+		year = year ? (year - 1) : 99;
+	}
+	t->month = bin2bcd8(month);
+	t->year = bin2bcd8(year);
+	t->date = bin2bcd8(cal_month_len(month, year));
+}
+
+
+/* Number ordered like the time, to the hour (BCD year, month, date, hour) */
+static uint32_t dst_key(const ds3231_time_t *t)
+{
+	return ((uint32_t)t->year << 24) | ((uint32_t)t->month << 16) | ((uint16_t)t->date << 8) | t->hour;
+}
+
+
+/* dst_key() of a transition on a Sunday (1-4, 5 for last) of a month */
+static uint32_t dst_transition(uint8_t year, uint8_t month, uint8_t sunday, uint8_t hour)
+{
+	uint8_t date;
+
+	date = 1 + (7 - cal_dayofweek(1, month, 2000 + year)) % 7;  /* First Sunday */
+	date += (sunday - 1) * 7;
+	if(date > cal_month_len(month, year)) {  /* Month with four Sundays */
+		date -= 7;
+	}
+	return ((uint32_t)bin2bcd8(year) << 24) | ((uint32_t)bin2bcd8(month) << 16) |
+			((uint16_t)bin2bcd8(date) << 8) | bin2bcd8(hour);
+}
+
+
+/* DST state at key in year, and the next transition. DST runs past the
+ * new year where it ends earlier in the year than it starts */
+static void dst_update(uint32_t key, uint8_t year)
+{
+	uint32_t start = dst_transition(year, DST_START);
+	uint32_t end = dst_transition(year, DST_END);
+	uint32_t first = (start < end) ? start : end;
+	uint32_t last = (start < end) ? end : start;
+
+	dst_on = ((key >= start) != (key >= end)) != (start > end);
+	if(key < first) {
+		dst_next = first;
+	}
+	else if(key < last) {
+		dst_next = last;
+	}
+	else {
+		dst_next = ((uint32_t)bin2bcd8(year + 1) << 24) | 0x010100;  /* Next new year */
+	}
+}
+
+
+/* RTC (standard) time to the time shown, an hour ahead during DST.
+ * Returns true then */
+bool cal_dst_local(ds3231_time_t *t)
+{
+	uint32_t key = dst_key(t);
+
+	if(key >= dst_next) {
+		dst_update(key, bcd2bin8(t->year));
+	}
+	if(dst_on && bcd_inc(&t->hour, 0x23, 0)) {
+		next_day(t);
+	}
+	return dst_on;
+}
+
+
+/* Time set by the user (as shown) to standard time for the RTC */
+void cal_dst_standard(ds3231_time_t *t)
+{
+	ds3231_time_t std = *t;
+
+	if(t->hour) {
+		std.hour = bin2bcd8(bcd2bin8(t->hour) - 1);
+	}
+	else {
+		std.hour = 0x23;
+		prev_day(&std);
+	}
+	dst_update(dst_key(&std), bcd2bin8(std.year));
+	if(dst_on) {
+		*t = std;
+	}
+	dst_next = 0;  /* Time changed: work out again on next tick */
+}
+#endif
@@ -0,0 +1,37 @@
+/*
+ * calendar.h
+ *
+ *	Calendar calculations on DS3231 time
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef CALENDAR_H_
+#define CALENDAR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ds3231.h"
+
+
+/* Daylight saving time rules for CONFIG_DST */
+#define DST_EU_GMT			1		/* UK, Ireland, Portugal: last Sunday of March to last Sunday of October, 01:00 UTC */
+#define DST_EU_CET			2		/* Central Europe, same at 01:00 UTC */
+#define DST_EU_EET			3		/* Eastern Europe, same at 01:00 UTC */
+#define DST_US				4		/* US, Canada: second Sunday of March to first Sunday of November, 02:00 local */
+#define DST_AU				5		/* South east Australia: first Sunday of October to first Sunday of April, 02:00 standard */
+#define DST_NZ				6		/* New Zealand: last Sunday of September to first Sunday of April, 02:00 standard */
+
+
+/************ Function declarations *************/
+
+uint8_t cal_dayofweek(uint8_t date, uint8_t month, uint16_t year);
+uint8_t cal_month_len(uint8_t month, uint8_t year);
+uint32_t cal_seconds(const ds3231_time_t *t);
+void cal_tick(ds3231_time_t *t);
+bool cal_dst_local(ds3231_time_t *t);
+void cal_dst_standard(ds3231_time_t *t);
+
+
+#endif /* CALENDAR_H_ */
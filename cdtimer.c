@@ -0,0 +1,329 @@
+/*
+ * cdtimer.c
+ *
+ *	Multiple countdown timers kept in a queue sorted by expiry time,
+ *	and the incrementing timer. Both survive reset (checkpointed in EEPROM)
+ *
+ *	Running timers hold their absolute expiry second and are linked in
+ *	expiry order, so the 1 second tick only compares the queue head with
+ *	the current second. Sorting cost is paid once at start/resume.
+ *	Paused timers are out of the queue and hold their remaining seconds.
+ *	The incrementing timer holds its start second while running and its
+ *	elapsed seconds while paused.
+ *
+ *	Seconds count from 2000-01-01 on the RTC time line (cal_seconds()), so
+ *	timer state written to EEPROM on each state change (never per tick) is
+ *	still valid after a reset. Countdowns that expired while the power
+ *	was off fire on the first tick after boot.
+ *
+ *	That needs the RTC time to have run on through the reset. If it did
+ *	not (oscillator stopped, RTC not answering, or time earlier than the
+ *	checkpoint), running timers are restored paused at what they showed
+ *	when checkpointed, rather than run against the wrong time line.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include "eeprom_map.h"
+#include "eelog.h"
+#include "cdtimer.h"
+
+
+/* Timer slot states */
+#define CDT_FREE		0
+#define CDT_RUNNING		1
+#define CDT_PAUSED		2
+
+#define CDT_CHECKPOINT_VERSION	2
+
+typedef struct _cdt_t {
+	uint32_t t;			/* Expiry second if running, remaining seconds if paused */
+	uint8_t state;
+} cdt_t;
+
+/* Checkpoint record */
+typedef struct _timers_t {
+	cdt_t cdt[CDT_MAX];
+	uint32_t upt;		/* Start second if running, elapsed seconds if paused */
+	uint8_t upt_state;
+	uint32_t now;		/* Second of the checkpoint */
+} timers_t;
+
+
+static timers_t	tmr;
+static uint8_t	cdt_head = CDT_NONE;
+static uint8_t	cdt_next[CDT_MAX];	/* Next timer in queue, rebuilt on restore */
+static uint32_t cdt_now;		/* Seconds on RTC time line */
+static eelog_t	ck_log = EELOG_INIT(EE_TIMERS_START, EE_TIMERS_SLOT_SIZE, EE_TIMERS_SLOTS, CDT_CHECKPOINT_VERSION);
+
+/* Record must fit in EEPROM slot (with tag, sequence and CRC) */
+typedef char timers_size_check[(sizeof(timers_t) + 3 <= EE_TIMERS_SLOT_SIZE) ? 1 : -1];
+
+
+/* Link timer into queue in expiry order */
+static void queue_insert(uint8_t id)
+{
+	uint8_t *link = &cdt_head;
+
+	while((*link != CDT_NONE) && (tmr.cdt[*link].t <= tmr.cdt[id].t)) {
+		link = &cdt_next[*link];
+	}
+	cdt_next[id] = *link;
+	*link = id;
+}
+
+
+/* Unlink timer from queue */
+static void queue_remove(uint8_t id)
+{
+	uint8_t *link = &cdt_head;
+
+	while(*link != CDT_NONE) {
+		if(*link == id) {
+			*link = cdt_next[id];
+			break;
+		}
+		link = &cdt_next[*link];
+	}
+}
+
+
+/* Write timer state to EEPROM. Called only on state changes */
+static void checkpoint(void)
+{
+	tmr.now = cdt_now;
+	eelog_append(&ck_log, &tmr, sizeof(tmr));
+}
+
+
+/* Restore timers at boot. now: current RTC second, valid: RTC time ran
+ * on through the reset. Running timers are paused if it did not */
+void cdt_restore(uint32_t now, bool valid)
+{
+	uint8_t id;
+	bool pause;
+
+	cdt_now = now;
+	if(!eelog_load(&ck_log, &tmr, sizeof(tmr))) {
+		return;
+	}
+	pause = !valid || (now < tmr.now);
+	for(id = 0; id < CDT_MAX; id++) {  /* Rebuild queue */
+		if(CDT_RUNNING == tmr.cdt[id].state) {
+			if(pause) {
+				tmr.cdt[id].state = CDT_PAUSED;
+				tmr.cdt[id].t = (tmr.cdt[id].t > tmr.now) ? (tmr.cdt[id].t - tmr.now) : 1;  /* Expired: fires on resume */
+			}
+			else {
+				queue_insert(id);
+			}
+		}
+		else if(tmr.cdt[id].state != CDT_PAUSED) {
+			tmr.cdt[id].state = CDT_FREE;
+		}
+	}
+	if(pause && (CDT_RUNNING == tmr.upt_state)) {
+		tmr.upt_state = CDT_PAUSED;
+		tmr.upt = tmr.now - tmr.upt;
+	}
+	if(pause) {
+		checkpoint();  /* On the new time line */
+	}
+}
+
+
+/* Advance time by one second. Call on every RTC tick */
+void cdt_tick(void)
+{
+	cdt_now++;
+}
+
+
+/* Correct time from RTC, in case ticks were missed */
+void cdt_sync(uint32_t now)
+{
+	cdt_now = now;
+}
+
+
+/* RTC time was changed: keep remaining/elapsed time of running timers */
+void cdt_rebase(uint32_t now)
+{
+	uint32_t delta = now - cdt_now;
+	uint8_t id;
+
+	for(id = 0; id < CDT_MAX; id++) {
+		if(CDT_RUNNING == tmr.cdt[id].state) {
+			tmr.cdt[id].t += delta;
+		}
+	}
+	if(CDT_RUNNING == tmr.upt_state) {
+		tmr.upt += delta;
+	}
+	cdt_now = now;
+	checkpoint();
+}
+
+
+/* Return id of an expired timer and release it, or CDT_NONE.
+ * Only the queue head needs to be checked */
+uint8_t cdt_expired(void)
+{
+	uint8_t id = cdt_head;
+
+	if((id != CDT_NONE) && (tmr.cdt[id].t <= cdt_now)) {
+		cdt_head = cdt_next[id];
+		tmr.cdt[id].state = CDT_FREE;
+		checkpoint();
+		return id;
+	}
+	return CDT_NONE;
+}
+
+
+/* Return a free timer id or CDT_NONE if all are in use */
+uint8_t cdt_alloc(void)
+{
+	uint8_t id;
+
+	for(id = 0; id < CDT_MAX; id++) {
+		if(CDT_FREE == tmr.cdt[id].state) {
+			return id;
+		}
+	}
+	return CDT_NONE;
+}
+
+
+/* Start timer to expire after given seconds */
+void cdt_start(uint8_t id, uint32_t secs)
+{
+	if(CDT_RUNNING == tmr.cdt[id].state) {
+		queue_remove(id);
+	}
+	tmr.cdt[id].t = cdt_now + secs;
+	tmr.cdt[id].state = CDT_RUNNING;
+	queue_insert(id);
+	checkpoint();
+}
+
+
+void cdt_pause(uint8_t id)
+{
+	if(CDT_RUNNING == tmr.cdt[id].state) {
+		queue_remove(id);
+		tmr.cdt[id].t -= cdt_now;
+		tmr.cdt[id].state = CDT_PAUSED;
+		checkpoint();
+	}
+}
+
+
+void cdt_resume(uint8_t id)
+{
+	if(CDT_PAUSED == tmr.cdt[id].state) {
+		cdt_start(id, tmr.cdt[id].t);
+	}
+}
+
+
+/* Cancel timer and release it */
+void cdt_free(uint8_t id)
+{
+	if(CDT_RUNNING == tmr.cdt[id].state) {
+		queue_remove(id);
+	}
+	tmr.cdt[id].state = CDT_FREE;
+	checkpoint();
+}
+
+
+bool cdt_paused(uint8_t id)
+{
+	return (CDT_PAUSED == tmr.cdt[id].state);
+}
+
+
+/* Remaining seconds of timer */
+uint32_t cdt_remaining(uint8_t id)
+{
+	if(CDT_RUNNING == tmr.cdt[id].state) {
+		return (tmr.cdt[id].t > cdt_now) ? (tmr.cdt[id].t - cdt_now) : 0;
+	}
+	return (CDT_PAUSED == tmr.cdt[id].state) ? tmr.cdt[id].t : 0;
+}
+
+
+/* Return the running timer expiring first, else any paused timer, else CDT_NONE */
+uint8_t cdt_soonest(void)
+{
+	uint8_t id;
+
+	if(cdt_head != CDT_NONE) {
+		return cdt_head;
+	}
+	for(id = 0; id < CDT_MAX; id++) {
+		if(CDT_PAUSED == tmr.cdt[id].state) {
+			return id;
+		}
+	}
+	return CDT_NONE;
+}
+
+
+/* Number of timers in use */
+uint8_t cdt_count(void)
+{
+	uint8_t id, count = 0;
+
+	for(id = 0; id < CDT_MAX; id++) {
+		if(tmr.cdt[id].state != CDT_FREE) {
+			count++;
+		}
+	}
+	return count;
+}
+
+
+/* Start or resume incrementing timer */
+void upt_start(void)
+{
+	if(tmr.upt_state != CDT_RUNNING) {
+		tmr.upt = cdt_now - tmr.upt;  /* Elapsed to start second */
+		tmr.upt_state = CDT_RUNNING;
+		checkpoint();
+	}
+}
+
+
+void upt_pause(void)
+{
+	if(CDT_RUNNING == tmr.upt_state) {
+		tmr.upt = cdt_now - tmr.upt;  /* Start second to elapsed */
+		tmr.upt_state = CDT_PAUSED;
+		checkpoint();
+	}
+}
+
+
+/* Stop and clear incrementing timer */
+void upt_clear(void)
+{
+	tmr.upt = 0;
+	tmr.upt_state = CDT_FREE;
+	checkpoint();
+}
+
+
+bool upt_running(void)
+{
+	return (CDT_RUNNING == tmr.upt_state);
+}
+
+
+/* Elapsed seconds of incrementing timer */
+uint32_t upt_elapsed(void)
+{
+	return (CDT_RUNNING == tmr.upt_state) ? (cdt_now - tmr.upt) : tmr.upt;
+}
@@ -0,0 +1,46 @@
+/*
+ * cdtimer.h
+ *
+ *	Multiple countdown timers kept in a queue sorted by expiry time,
+ *	and the incrementing timer. Both survive reset (checkpointed in EEPROM)
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef CDTIMER_H_
+#define CDTIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define CDT_MAX				4		/* Number of countdown timers */
+#define CDT_NONE			0xFF	/* Invalid timer id / end of queue */
+
+
+/************ Function declarations *************/
+
+void cdt_restore(uint32_t now, bool valid);
+void cdt_tick(void);
+void cdt_sync(uint32_t now);
+void cdt_rebase(uint32_t now);
+uint8_t cdt_expired(void);
+uint8_t cdt_alloc(void);
+void cdt_start(uint8_t id, uint32_t secs);
+void cdt_pause(uint8_t id);
+void cdt_resume(uint8_t id);
+void cdt_free(uint8_t id);
+bool cdt_paused(uint8_t id);
+uint32_t cdt_remaining(uint8_t id);
+uint8_t cdt_soonest(void);
+uint8_t cdt_count(void);
+
+void upt_start(void);
+void upt_pause(void);
+void upt_clear(void);
+bool upt_running(void);
+uint32_t upt_elapsed(void);
+
+
+#endif /* CDTIMER_H_ */
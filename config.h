@@ -0,0 +1,59 @@
+/*
+ * config.h
+ *
+ *	Build time configuration of Digital Clock features
+ *
+ *	Not all of them fit in the 8KB flash together (7KB below the
+ *	bootloader), so only the console is on by default: board v2 has no
+ *	button and is set from it. Check 'make size-boards' after turning
+ *	others on.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+
+#define CONFIG_24HR_FORMAT	0		// Define to 1 for 00-23 hour display by default (can be changed at runtime) */
+
+/* Stopwatch with 1/100 s resolution, counting the 32kHz output of DS3231
+ * on T1 (PD5). Needs 32K pin of the RTC module wired to PD5 */
+#define CONFIG_STOPWATCH	0
+
+/* Receive only serial console on RXD (PD0) for setting time, alarm,
+ * timers and brightness in one command. See console.c */
+#define CONFIG_CONSOLE		1
+
+/* Battery voltage and RTC temperature logged in EEPROM every hour for
+ * about a week. Dump with 'L=dump' on the console. See history.c */
+#define CONFIG_HISTORY		0
+
+/* Charge consumed and projected runtime from time spent in each power
+ * state (long press on battery page). Uses Timer1 while the stopwatch is
+ * not running. See energy.c */
+#define CONFIG_ENERGY		0
+
+/* 'U=boot' on the console starts the serial bootloader for a firmware
+ * update (tools/boot_flash.py). Needs the bootloader programmed, see boot.c */
+#define CONFIG_BOOTLOADER	0
+
+/* Display blanked during quiet hours set from the console ('Q=hhhh',
+ * start and end hour), a button press shows the time for a few seconds */
+#define CONFIG_QUIET_HOURS	0
+
+/* Daylight saving time rule, one of DST_* in calendar.h (0 for none). The
+ * RTC keeps standard time, the time shown and alarms are an hour ahead
+ * during DST */
+#define CONFIG_DST			0
+
+/* Power profile from supply, told from battery voltage (fuelgauge.c): full
+ * brightness and blinking colon on charger, brightness set from console,
+ * steady colon and slower battery sampling on battery. With the time
+ * shown, the RTC alarm then wakes only at the next minute (or whatever is
+ * due sooner) and day/date are not cycled in */
+#define CONFIG_POWER_PROFILES	0
+
+
+#endif /* CONFIG_H_ */
@@ -0,0 +1,341 @@
+/*
+ * console.c
+ *
+ *	Serial command console on USART RXD (PD0), with EEPROM dump on TXD (PD1)
+ *
+ *	Only the receiver is normally enabled, TXD (PD1) is TM1637 DIO. The
+ *	transmitter is turned on just for a dump: with TM1637 CLK idle high,
+ *	DIO edges are only start/stop conditions to it, so the display simply
+ *	keeps its contents.
+ *	USART needs the CPU clock, so the console is on only for CONSOLE_WINDOW
+ *	seconds after boot or after the last valid command, and the clock sleeps
+ *	in Idle mode meanwhile. RXD has no pin interrupt to wake on, so while
+ *	off it listens for CONSOLE_LISTEN seconds at the start of each minute:
+ *	a host repeating its line for over a minute gets in without a reset
+ *	(a valid line keeps it on for CONSOLE_WINDOW as after boot).
+ *
+ *	A command line holds any of the fields below separated by spaces, and
+ *	ends with '*' and the XOR of all preceding characters as 2 hex digits:
+ *
+ *		T=hhmmss  D=ddmmyy  A=hhmm  A=off  C=hhmmss  B=n (0-3)  F=12/24
+ *		L=dump  V=mmmm (battery mV read by multimeter, calibrates fuel gauge)
+ *		U=boot (firmware update, CONFIG_BOOTLOADER)
+ *		Q=hhhh (quiet hours start and end hour)  Q=off
+ *
+ *	Example: "T=142530 D=181026 A=0630 B=1*0A\n"
+ *	There is no reply, so the host repeats the line (tools/clock_sync.py).
+ *	L=dump sends the history log as lines of "L=aaaa:<16 hex bytes>*HH",
+ *	with the same checksum (tools/hist_decode.py).
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <string.h>
+#include "console.h"
+#include "calendar.h"
+
+#if CONFIG_CONSOLE
+
+/* Double speed mode keeps baud error low at low F_CPU */
+#define UBRR_VALUE		((F_CPU + 4UL * CONSOLE_BAUD) / (8UL * CONSOLE_BAUD) - 1)
+
+static char				line[CONSOLE_LINE_MAX];
+static volatile uint8_t	line_len;
+static volatile bool	line_ready;
+static uint8_t			window;
+static uint8_t			tx_sum;
+
+
+static void console_on(uint8_t secs)
+{
+	PORTD |= (1 << PD0);  /* Pull up when nothing is connected */
+	UBRRH = (uint8_t)(UBRR_VALUE >> 8);
+	UBRRL = (uint8_t)UBRR_VALUE;
+	UCSRA = (1 << U2X);
+	UCSRC = (1 << URSEL)|(1 << UCSZ1)|(1 << UCSZ0);  /* 8N1 */
+	UCSRB = (1 << RXCIE)|(1 << RXEN);
+	line_len = 0;
+	line_ready = false;
+	window = secs;
+}
+
+
+void console_init(void)
+{
+	console_on(CONSOLE_WINDOW);
+}
+
+
+void console_off(void)
+{
+	UCSRB = 0;
+	PORTD &= ~(1 << PD0);
+	window = 0;
+}
+
+
+bool console_enabled(void)
+{
+	return (window != 0);
+}
+
+
+/* Call every second. Turns console off after the window */
+void console_tick(void)
+{
+	if(window && !--window) {
+		console_off();
+	}
+}
+
+
+/* Call at the start of each minute: short listen window while off */
+void console_listen(void)
+{
+	if(!window) {
+		console_on(CONSOLE_LISTEN);
+	}
+}
+
+
+static uint8_t hex_digit(char c)
+{
+	if((c >= '0') && (c <= '9')) {
+		return c - '0';
+	}
+	if((c >= 'A') && (c <= 'F')) {
+		return c - 'A' + 10;
+	}
+	return 0xFF;
+}
+
+
+/* Parse n pairs of decimal digits into BCD bytes, checking each against max */
+static bool parse_bcd(const char *s, uint8_t *bcd, uint8_t n, const uint8_t *max)
+{
+	uint8_t i, hi, lo;
+
+	for(i = 0; i < n; i++) {
+		hi = (uint8_t)(*s++ - '0');
+		lo = (uint8_t)(*s++ - '0');
+		if((hi > 9) || (lo > 9)) {
+			return false;
+		}
+		bcd[i] = (hi << 4) | lo;
+		if(bcd[i] > max[i]) {
+			return false;
+		}
+	}
+	return ((*s == ' ') || (*s == '*'));
+}
+
+
+/* Date (BCD date, month, year) is a day of that month */
+static bool date_ok(const uint8_t *date)
+{
+	uint8_t day = (date[0] >> 4) * 10 + (date[0] & 0xF);
+	uint8_t month = (date[1] >> 4) * 10 + (date[1] & 0xF);
+
+	return day && month && (day <= cal_month_len(month, (date[2] >> 4) * 10 + (date[2] & 0xF)));
+}
+
+
+static bool parse(char *p, console_cmd_t *cmd)
+{
+	static const uint8_t max_hms[] = {0x99, 0x59, 0x59};
+	static const uint8_t max_time[] = {0x23, 0x59, 0x59};
+	static const uint8_t max_date[] = {0x31, 0x12, 0x99};
+	static const uint8_t max_mv[] = {0x99, 0x99};
+#if CONFIG_QUIET_HOURS
+	static const uint8_t max_quiet[] = {0x23, 0x23};  /* Start and end hour */
+#endif
+	uint8_t bcd[2];
+	bool ok = true;
+
+	cmd->flags = 0;
+	while(ok && (*p != '*')) {
+		if(' ' == *p) {
+			p++;
+			continue;
+		}
+		if(p[1] != '=') {
+			return false;
+		}
+		switch(*p) {
+		case 'T':
+			ok = parse_bcd(p+2, cmd->time, 3, max_time);
+			cmd->flags |= CMD_TIME;
+			break;
+		case 'D':
+			ok = parse_bcd(p+2, cmd->date, 3, max_date) && date_ok(cmd->date);
+			cmd->flags |= CMD_DATE;
+			break;
+		case 'A':
+			if(0 == strncmp(p+2, "off", 3)) {
+				cmd->flags |= CMD_ALARM_OFF;
+			}
+			else {
+				ok = parse_bcd(p+2, cmd->alarm, 2, max_time);
+				cmd->flags |= CMD_ALARM;
+			}
+			break;
+		case 'C':
+			ok = parse_bcd(p+2, cmd->timer, 3, max_hms);
+			cmd->flags |= CMD_TIMER;
+			break;
+		case 'B':
+			cmd->bright = (uint8_t)(p[2] - '0');
+			ok = (cmd->bright < 4);
+			cmd->flags |= CMD_BRIGHT;
+			break;
+		case 'V':
+			ok = parse_bcd(p+2, bcd, 2, max_mv);
+			cmd->vbat = (uint16_t)(bcd[0] >> 4) * 1000 + (bcd[0] & 0xF) * 100 + (bcd[1] >> 4) * 10 + (bcd[1] & 0xF);
+			cmd->flags |= CMD_VBAT;
+			break;
+		case 'L':
+			ok = (0 == strncmp(p+2, "dump", 4));
+			cmd->flags |= CMD_DUMP;
+			break;
+#if CONFIG_QUIET_HOURS
+		case 'Q':
+			if(0 == strncmp(p+2, "off", 3)) {
+				cmd->flags |= CMD_QUIET_OFF;
+			}
+			else {
+				ok = parse_bcd(p+2, cmd->quiet, 2, max_quiet);
+				cmd->flags |= CMD_QUIET;
+			}
+			break;
+#endif
+#if CONFIG_BOOTLOADER
+		case 'U':
+			ok = (0 == strncmp(p+2, "boot", 4));
+			cmd->flags |= CMD_BOOT;
+			break;
+#endif
+		case 'F':
+			cmd->fmt24 = (p[2] == '2');
+			ok = (0 == strncmp(p+2, "12", 2)) || (0 == strncmp(p+2, "24", 2));
+			cmd->flags |= CMD_FORMAT;
+			break;
+		default:
+			return false;
+		}
+		while((*p != ' ') && (*p != '*')) {
+			p++;
+		}
+	}
+	return ok;
+}
+
+
+/* Get a received command line. Returns true if a line with valid
+ * checksum and fields was parsed into cmd */
+bool console_read(console_cmd_t *cmd)
+{
+	uint8_t i, sum = 0;
+	bool ok = false;
+
+	if(!line_ready) {
+		return false;
+	}
+	for(i = 0; (i < line_len) && (line[i] != '*'); i++) {
+		sum ^= (uint8_t)line[i];
+	}
+	if((i + 3 == line_len) &&
+		(sum == ((hex_digit(line[i+1]) << 4) | hex_digit(line[i+2])))) {
+		ok = parse(line, cmd);
+	}
+	if(ok) {
+		window = CONSOLE_WINDOW;  /* Keep listening while host is sending */
+	}
+	line_len = 0;
+	line_ready = false;
+	return ok;
+}
+
+
+/* True while a received line waits for console_read() (check before sleep) */
+bool console_line_ready(void)
+{
+	return line_ready;
+}
+
+
+/* Send a character, adding it to the line checksum */
+static void tx_char(char c)
+{
+	while(!(UCSRA & (1 << UDRE)));
+	UDR = c;
+	tx_sum ^= (uint8_t)c;
+}
+
+
+static void tx_hex(uint8_t val)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	tx_char(hex[val >> 4]);
+	tx_char(hex[val & 0xF]);
+}
+
+
+/* Send EEPROM contents, 16 bytes a line. Blocks for about 50ms a line */
+void console_dump(uint16_t start, uint16_t len)
+{
+	uint16_t addr;
+	uint8_t i;
+
+	UCSRB |= (1 << TXEN);
+	for(addr = start; addr < start + len; addr += 16) {
+		tx_sum = 0;
+		tx_char('L');
+		tx_char('=');
+		tx_hex((uint8_t)(addr >> 8));
+		tx_hex((uint8_t)addr);
+		tx_char(':');
+		for(i = 0; i < 16; i++) {
+			tx_hex(eeprom_read_byte((const uint8_t *)(addr + i)));
+		}
+		i = tx_sum;
+		tx_char('*');
+		tx_hex(i);
+		tx_char('\r');
+		while(!(UCSRA & (1 << UDRE)));
+		UCSRA |= (1 << TXC);  /* Cleared by writing 1 */
+		UDR = '\n';
+	}
+	while(!(UCSRA & (1 << TXC)));  /* Last stop bit out before releasing PD1 */
+	UCSRB &= ~(1 << TXEN);
+}
+
+
+/* Budget: ISR_BUDGET_USART_RXC cycles */
+ISR(USART_RXC_vect)
+{
+	char c = UDR;
+	uint8_t len = line_len;
+
+	if(line_ready) {  /* Previous line not yet processed */
+		return;
+	}
+	if(('\n' == c) || ('\r' == c)) {
+		if(len) {
+			line_ready = true;
+		}
+	}
+	else if(len < (CONSOLE_LINE_MAX - 1)) {
+		line[len] = c;
+		line_len = len + 1;
+	}
+	else {  /* Too long, discard */
+		line_len = 0;
+	}
+}
+
+#endif /* CONFIG_CONSOLE */
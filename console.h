@@ -0,0 +1,63 @@
+/*
+ * console.h
+ *
+ *	Serial command console on USART RXD (PD0), with EEPROM dump on TXD (PD1)
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+
+#define CONSOLE_BAUD		9600
+#define CONSOLE_WINDOW		10		/* Seconds console stays on after boot or last command */
+#define CONSOLE_LISTEN		2		/* Seconds console is on each minute while off */
+#define CONSOLE_LINE_MAX	48
+
+/* Fields present in a command line */
+#define CMD_TIME			0x01	/* T=hhmmss */
+#define CMD_DATE			0x02	/* D=ddmmyy */
+#define CMD_ALARM			0x04	/* A=hhmm */
+#define CMD_ALARM_OFF		0x08	/* A=off */
+#define CMD_TIMER			0x10	/* C=hhmmss */
+#define CMD_BRIGHT			0x20	/* B=n */
+#define CMD_FORMAT			0x40	/* F=12 or F=24 */
+#define CMD_DUMP			0x80	/* L=dump */
+#define CMD_VBAT			0x100	/* V=mmmm */
+#define CMD_BOOT			0x200	/* U=boot */
+#define CMD_QUIET			0x400	/* Q=hhhh */
+#define CMD_QUIET_OFF		0x800	/* Q=off */
+
+/* Parsed command line. Time values are BCD */
+typedef struct _console_cmd_t {
+	uint16_t flags;
+	uint8_t time[3];	/* hour, min, sec */
+	uint8_t date[3];	/* date, month, year */
+	uint8_t alarm[2];	/* hour, min */
+	uint8_t timer[3];	/* hour, min, sec */
+	uint8_t bright;
+	bool fmt24;
+	uint16_t vbat;		/* Battery voltage (mV) for fuel gauge calibration */
+	uint8_t quiet[2];	/* Quiet hours start, end hour */
+} console_cmd_t;
+
+
+/************ Function declarations *************/
+
+void console_init(void);
+void console_off(void);
+bool console_enabled(void);
+void console_tick(void);
+void console_listen(void);
+bool console_read(console_cmd_t *cmd);
+bool console_line_ready(void);
+void console_dump(uint16_t start, uint16_t len);
+
+
+#endif /* CONSOLE_H_ */
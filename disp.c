@@ -0,0 +1,183 @@
+/*
+ * disp.c
+ *
+ *	Display framebuffer with blink and roll animation
+ *
+ *	Callers build a full frame (segment patterns) and hand it over with
+ *	disp_set(). The frame seen is the framebuffer with blinking digits
+ *	blanked in the off phase, and rolling digits replaced by the roll
+ *	steps: old digit slid up by half, new digit half in from below.
+ *	Only digits that differ from what the TM1637 shows are sent.
+ *
+ *	Animation time is counted in Timer0 ticks by the caller: disp_set()
+ *	and disp_step() return the ticks to the next animation step (0 when
+ *	nothing is animating), and disp_step() is called once they are over.
+ *	Blink and roll do not run together, blinking cancels a roll.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <string.h>
+#include "tm1637.h"
+#include "disp.h"
+
+
+#define ROLL_STEPS			2		/* Frames between old and new digit */
+
+/* TM1637 segments: bit 0 'a' (top) clockwise to bit 5 'f', bit 6 'g' (middle) */
+#define SEG_A				0x01
+#define SEG_B				0x02
+#define SEG_C				0x04
+#define SEG_D				0x08
+#define SEG_E				0x10
+#define SEG_F				0x20
+#define SEG_G				0x40
+
+
+static uint8_t fb[DISP_DIGITS];		/* Frame to show */
+static uint8_t fb_dot;
+static uint8_t old[DISP_DIGITS];	/* Frame rolling out */
+static uint8_t sent[DISP_DIGITS];	/* Frame on the display */
+static uint8_t sent_dot;
+static bool sent_valid;
+
+static uint8_t blink_mask;			/* Bit n for digit n */
+static uint8_t blink_ticks;
+static bool blink_off;
+
+static uint8_t roll_mask;
+static uint8_t roll_step;
+static uint8_t roll_ticks;
+
+
+/* Lower half of a digit moved to the upper half */
+static uint8_t seg_up(uint8_t s)
+{
+	return ((s & SEG_G) ? SEG_A : 0) | ((s & SEG_C) ? SEG_B : 0) |
+			((s & SEG_E) ? SEG_F : 0) | ((s & SEG_D) ? SEG_G : 0);
+}
+
+
+/* Upper half of a digit moved to the lower half */
+static uint8_t seg_down(uint8_t s)
+{
+	return ((s & SEG_A) ? SEG_G : 0) | ((s & SEG_B) ? SEG_C : 0) |
+			((s & SEG_F) ? SEG_E : 0) | ((s & SEG_G) ? SEG_D : 0);
+}
+
+
+/* Send the digits that changed since last sent, returns ticks to next step.
+ * tm1637_send_digits() writes from the first digit, so the frame is cut
+ * after the last one that changed */
+static uint8_t push(void)
+{
+	uint8_t frame[DISP_DIGITS];
+	uint8_t i, bit, n = 0;
+
+	for(i = 0, bit = 1; i < DISP_DIGITS; i++, bit <<= 1) {
+		if(blink_off && (blink_mask & bit)) {
+			frame[i] = 0;
+		}
+		else if(roll_mask & bit) {
+			frame[i] = roll_step ? seg_down(fb[i]) : seg_up(old[i]);
+		}
+		else {
+			frame[i] = fb[i];
+		}
+		if(!sent_valid || (frame[i] != sent[i])) {
+			n = i + 1;
+		}
+	}
+	if(!sent_valid || (fb_dot != sent_dot)) {  /* Dot of digit dot_pos-1 */
+		if(fb_dot > n) {
+			n = fb_dot;
+		}
+		if(sent_dot > n) {
+			n = sent_dot;
+		}
+	}
+
+	if(n) {
+		memcpy(sent, frame, sizeof(sent));
+		sent_dot = fb_dot;
+		sent_valid = true;
+		tm1637_send_digits(frame, n, fb_dot);
+	}
+
+	if(roll_mask) {
+		return roll_ticks;
+	}
+	return blink_mask ? blink_ticks : 0;
+}
+
+
+/* Roll step length in Timer0 ticks */
+void disp_init(uint8_t ticks)
+{
+	roll_ticks = ticks;
+}
+
+
+/* Blink digits in mask (bit n for digit n, 0 to stop) with half period in
+ * Timer0 ticks. Takes effect on the next disp_set() */
+void disp_blink(uint8_t mask, uint8_t half_ticks)
+{
+	if(mask != blink_mask) {
+		blink_off = false;  /* Newly blinking digits start visible */
+		blink_mask = mask;
+	}
+	blink_ticks = half_ticks;
+	if(mask) {
+		roll_mask = 0;
+	}
+}
+
+
+/* Show a frame of DISP_DIGITS segment patterns with colon/dot at dot_pos (0 for none).
+ * Digits in roll mask that changed roll over to the new pattern, blinking
+ * digits that changed are shown right away. Returns ticks to next step */
+uint8_t disp_set(const uint8_t *digits, uint8_t dot_pos, uint8_t roll)
+{
+	uint8_t i, bit, changed = 0;
+
+	for(i = 0, bit = 1; i < DISP_DIGITS; i++, bit <<= 1) {
+		if(digits[i] != fb[i]) {
+			changed |= bit;
+		}
+	}
+	if(changed & blink_mask) {
+		blink_off = false;
+	}
+	if(sent_valid && (changed & roll & ~blink_mask)) {  /* First frame shows at once */
+		memcpy(old, fb, sizeof(old));
+		roll_mask = changed & roll;
+		roll_step = 0;
+	}
+	memcpy(fb, digits, sizeof(fb));
+	fb_dot = dot_pos;
+
+	return push();
+}
+
+
+/* Next animation step, once the ticks returned last are over */
+uint8_t disp_step(void)
+{
+	if(roll_mask) {
+		if(++roll_step >= ROLL_STEPS) {
+			roll_mask = 0;
+		}
+	}
+	else if(blink_mask) {
+		blink_off = !blink_off;
+	}
+	return push();
+}
+
+
+/* Display contents are unknown (DIO was used by UART), send all on next frame */
+void disp_invalidate(void)
+{
+	sent_valid = false;
+}
@@ -0,0 +1,29 @@
+/*
+ * disp.h
+ *
+ *	Display framebuffer with blink and roll animation
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef DISP_H_
+#define DISP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define DISP_DIGITS			4
+
+
+/************ Function declarations *************/
+
+void disp_init(uint8_t roll_ticks);
+void disp_blink(uint8_t mask, uint8_t half_ticks);
+uint8_t disp_set(const uint8_t *digits, uint8_t dot_pos, uint8_t roll);
+uint8_t disp_step(void);
+void disp_invalidate(void);
+
+
+#endif /* DISP_H_ */
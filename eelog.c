@@ -0,0 +1,74 @@
+/*
+ * eelog.c
+ *
+ *	Append only record log in EEPROM with wear levelling and CRC
+ *
+ *	Each append goes to the next slot of a ring, so every slot is written
+ *	once per 'slots' appends. A record is tag, sequence number, data and
+ *	CRC-8. The newest valid record with the expected tag wins on load, so a
+ *	write torn by reset or brown out falls back to the previous record.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <string.h>
+#include "eelog.h"
+
+
+static uint8_t crc8(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while(len--) {
+		crc = _crc_ibutton_update(crc, *data++);
+	}
+	return crc;
+}
+
+
+static uint8_t *slot_addr(const eelog_t *log, uint8_t slot)
+{
+	return (uint8_t *)(log->start + (uint16_t)slot * log->slot_size);
+}
+
+
+/* Load data of newest valid record. Returns false if none, data is left unchanged */
+bool eelog_load(eelog_t *log, void *data, uint8_t len)
+{
+	uint8_t rec[EELOG_MAX_RECORD];
+	uint8_t slot;
+	bool found = false;
+
+	for(slot = 0; slot < log->slots; slot++) {
+		eeprom_read_block(rec, slot_addr(log, slot), len + 3);
+		if((rec[0] != log->tag) || (rec[len + 2] != crc8(rec, len + 2))) {
+			continue;
+		}
+		if(!found || ((int8_t)(rec[1] - log->seq) > 0)) {
+			found = true;
+			log->seq = rec[1];
+			log->slot = slot;
+			memcpy(data, &rec[2], len);
+		}
+	}
+	return found;
+}
+
+
+/* Append record to the next slot */
+void eelog_append(eelog_t *log, const void *data, uint8_t len)
+{
+	uint8_t rec[EELOG_MAX_RECORD];
+
+	if(++log->slot >= log->slots) {
+		log->slot = 0;
+	}
+	rec[0] = log->tag;
+	rec[1] = ++log->seq;
+	memcpy(&rec[2], data, len);
+	rec[len + 2] = crc8(rec, len + 2);
+	eeprom_update_block(rec, slot_addr(log, log->slot), len + 3);
+}
@@ -0,0 +1,37 @@
+/*
+ * eelog.h
+ *
+ *	Append only record log in EEPROM with wear levelling and CRC
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef EELOG_H_
+#define EELOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define EELOG_MAX_RECORD	32		/* Largest slot size */
+
+typedef struct _eelog_t {
+	uint16_t start;			/* EEPROM address of first slot */
+	uint8_t slot_size;		/* Record size incl. tag, sequence and CRC bytes */
+	uint8_t slots;
+	uint8_t tag;			/* Record type and version */
+	uint8_t slot;			/* Last written slot */
+	uint8_t seq;			/* Last sequence number */
+} eelog_t;
+
+#define EELOG_INIT(start, slot_size, slots, tag)	{ (start), (slot_size), (slots), (tag), (slots) - 1, 0 }
+
+
+/************ Function declarations *************/
+
+bool eelog_load(eelog_t *log, void *data, uint8_t len);
+void eelog_append(eelog_t *log, const void *data, uint8_t len);
+
+
+#endif /* EELOG_H_ */
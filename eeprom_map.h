@@ -0,0 +1,31 @@
+/*
+ * eeprom_map.h
+ *
+ *	Allocation of the 512 byte ATmega8 EEPROM
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef EEPROM_MAP_H_
+#define EEPROM_MAP_H_
+
+
+/* Settings log : 8 slots of 16 bytes */
+#define EE_SETTINGS_START		0x000
+#define EE_SETTINGS_SLOT_SIZE	16
+#define EE_SETTINGS_SLOTS		8
+
+/* Running timers checkpoint : 4 slots of 32 bytes */
+#define EE_TIMERS_START			0x080
+#define EE_TIMERS_SLOT_SIZE		32
+#define EE_TIMERS_SLOTS			4
+
+/* Battery and temperature history : 8 blocks of 32 bytes */
+#define EE_HIST_START			0x100
+#define EE_HIST_BLOCK_SIZE		32
+#define EE_HIST_BLOCKS			8
+#define EE_HIST_SIZE			(EE_HIST_BLOCK_SIZE * EE_HIST_BLOCKS)
+
+
+#endif /* EEPROM_MAP_H_ */
@@ -0,0 +1,151 @@
+/*
+ * energy.c
+ *
+ *	Battery charge estimate from time spent in each power state
+ *
+ *	Every second the time at the present display brightness and buzzer
+ *	state, MCU running and Idle time (counted by power.c), and ADC and TWI
+ *	events are added up, and multiplied by the board current coefficients
+ *	(I_*_UA in board.h) to give the charge consumed since reset.
+ *
+ *	Average current is a running average over about an hour, updated each
+ *	minute, and gives the projected runtime on the remaining charge.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/pgmspace.h>
+#include "board.h"
+#include "fuelgauge.h"
+#include "power.h"
+#include "energy.h"
+
+#if CONFIG_ENERGY
+
+#define UAMS_PER_MAH		3600000000UL
+#define EN_AVG_SHIFT		6		/* Running average over 64 minutes */
+
+static const uint16_t disp_ua[] PROGMEM = I_DISP_UA;
+
+static energy_t			en;
+static uint8_t			adc_events;
+static uint8_t			twi_events;
+static uint32_t			minute_uams;	/* Charge in this minute */
+static uint8_t			minute_secs;
+static uint32_t			avg_ua;			/* Running average current, << EN_AVG_SHIFT */
+
+
+/* Add charge consumed over secs seconds, all in the same minute */
+static void charge_add(uint32_t uams, uint8_t secs)
+{
+	en.uams += uams;
+	while(en.uams >= UAMS_PER_MAH) {
+		en.uams -= UAMS_PER_MAH;
+		en.mah++;
+	}
+
+	minute_uams += uams;
+	minute_secs += secs;
+	if(minute_secs >= 60) {
+		uams = minute_uams / 60000UL;  /* Average uA over the minute */
+		if(avg_ua) {
+			avg_ua += uams - (avg_ua >> EN_AVG_SHIFT);
+		}
+		else {
+			avg_ua = uams << EN_AVG_SHIFT;  /* First minute */
+		}
+		minute_uams = 0;
+		minute_secs = 0;
+	}
+}
+
+
+/* Call every second after power_tick(), with present display brightness
+ * level (EN_DISP_OFF if blanked) and buzzer state */
+void energy_tick(uint8_t bright, bool buzzer)
+{
+	uint16_t run = power_last(PWR_RUN), idle = power_last(PWR_IDLE);
+	uint32_t uams;
+
+	en.adc += adc_events;
+	en.twi += twi_events;
+
+	uams = I_SLEEP_UA * 1000UL;
+	if(EN_DISP_OFF == bright) {
+		en.dark_s++;
+	}
+	else {
+		en.disp_s[bright]++;
+		uams += pgm_read_word(&disp_ua[bright]) * 1000UL;
+	}
+	if(buzzer) {
+		en.buzzer_s++;
+		uams += I_BUZZER_UA * 1000UL;
+	}
+	/* Awake time in 100us steps */
+	uams += ((uint32_t)run * PWR_T1_US / 100 * I_ACTIVE_UA + (uint32_t)idle * PWR_T1_US / 100 * I_IDLE_UA) / 10;
+	uams += ((uint32_t)adc_events * I_ADC_UA * FG_MEASURE_US) / 1000;
+	uams += ((uint32_t)twi_events * I_TWI_UA * EN_TWI_US) / 1000;
+	adc_events = 0;
+	twi_events = 0;
+
+	charge_add(uams, 1);
+}
+
+
+/* Seconds slept through in Power down with the display blanked, without
+ * energy_tick() (RTC tick off in quiet hours) */
+void energy_sleep(uint32_t secs)
+{
+	uint8_t n;
+
+	en.dark_s += secs;
+	while(secs) {
+		n = 60 - minute_secs;
+		if(n > secs) {
+			n = (uint8_t)secs;
+		}
+		charge_add((uint32_t)n * I_SLEEP_UA * 1000UL, n);
+		secs -= n;
+	}
+}
+
+
+void energy_event(uint8_t ev, uint8_t n)
+{
+	if(EN_ADC == ev) {
+		adc_events += n;
+	}
+	else {
+		twi_events += n;
+	}
+}
+
+
+uint16_t energy_mah(void)
+{
+	return en.mah;
+}
+
+
+uint16_t energy_avg_ua(void)
+{
+	return (uint16_t)(avg_ua >> EN_AVG_SHIFT);
+}
+
+
+/* Projected hours on remaining charge at average current */
+uint16_t energy_runtime_h(uint16_t remain_mah)
+{
+	uint32_t h;
+	uint16_t ua = energy_avg_ua();
+
+	if(!ua) {
+		return EN_RUNTIME_UNKNOWN;
+	}
+	h = ((uint32_t)remain_mah * 1000UL) / ua;
+	return (h < EN_RUNTIME_UNKNOWN) ? (uint16_t)h : (EN_RUNTIME_UNKNOWN - 1);
+}
+
+#endif /* CONFIG_ENERGY */
@@ -0,0 +1,49 @@
+/*
+ * energy.h
+ *
+ *	Battery charge estimate from time spent in each power state
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+
+/* Counted events */
+#define EN_ADC				0		/* Fuel gauge measurement */
+#define EN_TWI				1		/* RTC transaction */
+
+#define EN_TWI_US			1000	/* Bus time of one RTC transaction at 100kHz */
+#define EN_DISP_OFF			0xFF	/* energy_tick() brightness with display blanked */
+#define EN_RUNTIME_UNKNOWN	0xFFFF
+
+/* Totals since reset (read with debugger/simavr) */
+typedef struct _energy_t {
+	uint32_t disp_s[4];		/* Seconds at each brightness level */
+	uint32_t dark_s;		/* Seconds with display blanked */
+	uint32_t buzzer_s;
+	/* Time in each MCU power mode is in power_stats_t (power.c) */
+	uint16_t adc;			/* Events */
+	uint32_t twi;
+	uint16_t mah;			/* Charge consumed */
+	uint32_t uams;			/* ...and the part below 1mAh in uA.ms */
+} energy_t;
+
+
+/************ Function declarations *************/
+
+void energy_tick(uint8_t bright, bool buzzer);
+void energy_sleep(uint32_t secs);
+void energy_event(uint8_t ev, uint8_t n);
+uint16_t energy_mah(void);
+uint16_t energy_avg_ua(void);
+uint16_t energy_runtime_h(uint16_t remain_mah);
+
+
+#endif /* ENERGY_H_ */
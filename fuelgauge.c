@@ -0,0 +1,274 @@
+/*
+ * fuelgauge.c
+ *
+ *	Li-ion battery voltage and state of charge
+ *
+ *	Battery voltage (through the BAT_ADC divider) and the internal bandgap
+ *	are both measured against AVCC, so the ratio gives battery voltage
+ *	independent of the supply:
+ *
+ *		VBAT = FG_DIVIDER * VBG * ADC(BAT) / ADC(VBG)
+ *
+ *	The bandgap is 1.15-1.40V between parts, so it is calibrated per unit
+ *	from one multimeter reading of the battery (fg_calibrate()).
+ *
+ *	Voltage under load is corrected to open circuit voltage with the load
+ *	current given by the caller (display, buzzer), then mapped to state of
+ *	charge with a piecewise linear discharge curve.
+ *
+ *	The sampling interval doubles (up to FG_INTERVAL_MAX) while voltage
+ *	stays within FG_STABLE_MV, and drops back to the shortest on a step:
+ *	FG_INTERVAL_MIN, or FG_INTERVAL_ECO in economy.
+ *
+ *	The CHRG output of the charger is not usable (board.h), so external
+ *	power is told from the voltage: at the charger float level, or rising
+ *	from the lowest on battery (falling from the highest on charger) in
+ *	the last FG_EXT_REF_S seconds. The slow rise of a cell recovering
+ *	from a load so does not count, only a step. Plugging in or out is seen
+ *	at the next measurement, up to FG_INTERVAL_MAX later, and taken once
+ *	FG_EXT_CONFIRM measurements in a row agree, sampled at FG_INTERVAL_MIN
+ *	while in doubt.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include "board.h"
+#include "adc.h"
+#include "power.h"
+#include "fuelgauge.h"
+
+
+#define FG_SAMPLES			4		/* Averaged per measurement */
+#define FG_INTERVAL_MIN		10		/* Seconds */
+#define FG_INTERVAL_ECO		60		/* Shortest in economy */
+#define FG_INTERVAL_MAX		640
+#define FG_STABLE_MV		5		/* Change that counts as stable */
+#define FG_STEP_MV			25		/* Change that restarts fast sampling */
+
+/* Open circuit voltage (mV) to state of charge (%), in falling voltage */
+typedef struct _fg_point_t {
+	uint16_t mv;
+	uint8_t pct;
+} fg_point_t;
+
+static const fg_point_t fg_curve[] PROGMEM = {
+	{ 4200, 100 },
+	{ 4100,  90 },
+	{ 4000,  78 },
+	{ 3900,  64 },
+	{ 3800,  48 },
+	{ 3750,  36 },
+	{ 3700,  22 },
+	{ 3650,  12 },
+	{ 3550,   6 },
+	{ 3400,   2 },
+	{ 3000,   0 },
+};
+
+static uint16_t		vbg;		/* Calibrated bandgap, mV */
+static uint16_t		vbat;		/* Last open circuit voltage, mV (0 till first measurement) */
+static uint16_t		ratio;		/* Last ADC(BAT) / ADC(VBG) in 1/4096 */
+static uint16_t		interval = FG_INTERVAL_MIN;
+static uint16_t		interval_min = FG_INTERVAL_MIN;
+static uint16_t		wait;
+static bool			low;
+static bool			ext;		/* On external power */
+static uint16_t		ext_ref;	/* Lowest voltage on battery, highest on charger */
+static uint16_t		ext_age;	/* Seconds since ext_ref was taken over */
+static uint8_t		ext_seen;	/* Measurements in a row telling the other state */
+
+
+void fg_init(uint16_t vbg_mv)
+{
+	vbg = ((vbg_mv >= FG_VBG_MIN_MV) && (vbg_mv <= FG_VBG_MAX_MV)) ? vbg_mv : FG_VBG_MV;
+	wait = 0;  /* Measure on first tick */
+}
+
+
+static uint16_t samp_sum(uint8_t ch)
+{
+	uint16_t sum = 0;
+	uint8_t i;
+
+	adc_select_channel(ch);
+	_delay_us(100);  /* Bandgap start up, and input settling after switching mux */
+	power_adc_samp();  /* First conversion after switching is discarded */
+	for(i = 0; i < FG_SAMPLES; i++) {
+		sum += power_adc_samp();
+	}
+	return sum;
+}
+
+
+/* Battery to bandgap ratio (in 1/4096), with both against AVCC */
+static uint16_t measure(void)
+{
+	uint16_t bat, bg;
+
+	ADC_ENABLE();
+	bg = samp_sum(ADC_CHANNEL_VBG);
+	bat = samp_sum(BAT_ADC_CHANNEL);
+	ADC_DISABLE();  /* Draws current in sleep if left on */
+	return (bg) ? (uint16_t)(((uint32_t)bat << 12) / bg) : 0;
+}
+
+
+static uint16_t ratio_to_mv(uint16_t r)
+{
+	return (uint16_t)(((uint32_t)r * vbg * FG_DIVIDER) >> 12);
+}
+
+
+/* Call every second with present load current (mA). Returns true when
+ * a new measurement was taken */
+bool fg_tick(uint8_t load_ma)
+{
+	uint16_t mv, diff;
+	bool other;
+
+	if(ext_age < FG_EXT_REF_S) {
+		ext_age++;
+	}
+	if(wait) {
+		wait--;
+		return false;
+	}
+
+	ratio = measure();
+	mv = ratio_to_mv(ratio) + (uint16_t)(((uint32_t)load_ma * FG_RINT_MOHM) / 1000);
+	diff = (mv > vbat) ? (mv - vbat) : (vbat - mv);
+	if(diff >= FG_STEP_MV) {
+		interval = interval_min;
+	}
+	else if((diff <= FG_STABLE_MV) && (interval < FG_INTERVAL_MAX)) {
+		interval <<= 1;
+	}
+	vbat = mv;
+
+	if(!ext_ref) {
+		ext_ref = mv;
+	}
+	if(!ext) {
+		other = (mv >= FG_EXT_MV) || (mv >= ext_ref + FG_EXT_RISE_MV);
+	}
+	else {
+		other = (mv + FG_EXT_FALL_MV <= ext_ref) && (mv < FG_EXT_MV);
+	}
+	if(other) {
+		if(++ext_seen >= FG_EXT_CONFIRM) {
+			ext = !ext;
+			ext_seen = 0;
+			ext_ref = mv;
+			ext_age = 0;
+		}
+		else {
+			interval = FG_INTERVAL_MIN;  /* In doubt */
+		}
+	}
+	else {
+		ext_seen = 0;
+		if((ext_age >= FG_EXT_REF_S) || (ext ? (mv > ext_ref) : (mv < ext_ref))) {
+			ext_ref = mv;
+			ext_age = 0;
+		}
+	}
+	wait = interval - 1;
+
+	if(vbat < FG_LOW_MV) {
+		low = true;
+	}
+	else if(vbat > FG_OK_MV) {
+		low = false;
+	}
+	return true;
+}
+
+
+/* Seconds gone by without fg_tick() (RTC ticking only when something is
+ * due): a measurement due meanwhile is taken on the next tick */
+void fg_skip(uint32_t secs)
+{
+	wait = (wait > secs) ? (wait - secs) : 0;
+	ext_age = (ext_age + secs < FG_EXT_REF_S) ? (ext_age + secs) : FG_EXT_REF_S;
+}
+
+
+/* Calibrate bandgap so that the last measurement reads vbat_mv (battery
+ * voltage under the present load, as read by a multimeter). Returns
+ * the bandgap to be saved, or 0 if out of range */
+uint16_t fg_calibrate(uint16_t vbat_mv)
+{
+	uint32_t bg;
+
+	ratio = measure();
+	if(!ratio) {
+		return 0;
+	}
+	bg = (((uint32_t)vbat_mv << 12) / FG_DIVIDER + ratio / 2) / ratio;
+	if((bg < FG_VBG_MIN_MV) || (bg > FG_VBG_MAX_MV)) {
+		return 0;
+	}
+	vbg = (uint16_t)bg;
+	interval = interval_min;
+	ext_ref = 0;  /* Voltage scale changed */
+	wait = 0;  /* Re-measure with new calibration */
+	return vbg;
+}
+
+
+bool fg_valid(void)
+{
+	return (vbat != 0);
+}
+
+
+uint16_t fg_mv(void)
+{
+	return vbat;
+}
+
+
+uint8_t fg_percent(void)
+{
+	fg_point_t hi, lo;
+	uint8_t i;
+
+	memcpy_P(&hi, &fg_curve[0], sizeof(hi));
+	if(vbat >= hi.mv) {
+		return hi.pct;
+	}
+	for(i = 1; i < sizeof(fg_curve) / sizeof(fg_curve[0]); i++) {
+		memcpy_P(&lo, &fg_curve[i], sizeof(lo));
+		if(vbat >= lo.mv) {
+			return lo.pct + (uint8_t)(((uint32_t)(vbat - lo.mv) * (hi.pct - lo.pct)) / (hi.mv - lo.mv));
+		}
+		hi = lo;
+	}
+	return 0;
+}
+
+
+bool fg_low(void)
+{
+	return low;
+}
+
+
+/* True while on external power (charger) */
+bool fg_external(void)
+{
+	return ext;
+}
+
+
+/* Sample less often, for the economy power profile */
+void fg_economy(bool on)
+{
+	interval_min = on ? FG_INTERVAL_ECO : FG_INTERVAL_MIN;
+	if(interval < interval_min) {
+		interval = interval_min;
+	}
+}
@@ -0,0 +1,50 @@
+/*
+ * fuelgauge.h
+ *
+ *	Li-ion battery voltage and state of charge
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef FUELGAUGE_H_
+#define FUELGAUGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define FG_VBG_MV			1300	/* Nominal bandgap, used till calibrated */
+#define FG_VBG_MIN_MV		1150	/* Accepted calibration range */
+#define FG_VBG_MAX_MV		1450
+#define FG_DIVIDER			2		/* BAT_ADC resistor divider ratio */
+#define FG_RINT_MOHM		200		/* Cell + wiring resistance, for load compensation */
+
+#define FG_MEASURE_US		1240	/* ADC on time of one measurement (ADC clock 125kHz) */
+
+#define FG_LOW_MV			3000	/* Low battery below this */
+#define FG_OK_MV			3400	/* ...till above this */
+
+/* External power: charger holds the cell near 4.2V, or lifts it while charging */
+#define FG_EXT_MV			4170	/* On charger at or above this */
+#define FG_EXT_RISE_MV		40		/* ...or on this rise over the lowest on battery */
+#define FG_EXT_FALL_MV		50		/* On battery again after this fall from the highest on charger */
+#define FG_EXT_CONFIRM		3		/* Measurements in a row that must agree on a change */
+#define FG_EXT_REF_S		300		/* Lowest/highest taken over at most this long */
+
+
+/************ Function declarations *************/
+
+void fg_init(uint16_t vbg_mv);
+bool fg_tick(uint8_t load_ma);
+void fg_skip(uint32_t secs);
+uint16_t fg_calibrate(uint16_t vbat_mv);
+bool fg_valid(void);
+uint16_t fg_mv(void);
+uint8_t fg_percent(void);
+bool fg_low(void);
+bool fg_external(void);
+void fg_economy(bool on);
+
+
+#endif /* FUELGAUGE_H_ */
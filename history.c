@@ -0,0 +1,147 @@
+/*
+ * history.c
+ *
+ *	Battery and temperature history log in EEPROM
+ *
+ *	Samples are taken every HIST_INTERVAL_MIN minutes, on the interval
+ *	boundary. The log region is a ring of blocks, each starting with a
+ *	key sample and followed by 1 byte deltas:
+ *
+ *		0		sequence number (newest block has the highest, serial compare)
+ *		1-3		time of key sample in intervals since 2000-01-01 (LSB first)
+ *		4		interval in minutes
+ *		5-6		battery voltage in 5mV (LSB first)
+ *		7		temperature in 0.5 degC (signed)
+ *		8		CRC-8 of bytes 0-7
+ *		9-31	deltas, one per interval: bits 7:4 battery + 8, bits 3:0 temp + 7
+ *				0xFF (never a valid delta) marks the end
+ *
+ *	A missed interval (reset, time change) or a delta out of range starts
+ *	a new block. 8 blocks of 24 samples keep 7 to 8 days of hourly samples
+ *	when blocks are not cut short.
+ *	Decode a dump with tools/hist_decode.py
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "eeprom_map.h"
+#include "history.h"
+
+#if CONFIG_HISTORY
+
+#define HIST_HDR_SIZE		9
+#define HIST_DELTAS			(EE_HIST_BLOCK_SIZE - HIST_HDR_SIZE)
+#define HIST_NO_BLOCK		0xFF
+#define HIST_END			0xFF
+
+#define BLOCK_ADDR(b)		((uint8_t *)(EE_HIST_START + (uint16_t)(b) * EE_HIST_BLOCK_SIZE))
+
+#if (HIST_INTERVAL_MIN < 2) || (HIST_INTERVAL_MIN > 255)
+#error "HIST_INTERVAL_MIN out of range"
+#endif
+
+static uint8_t		blk;		/* Current block */
+static uint8_t		seq;		/* Its sequence number */
+static uint8_t		count;		/* Deltas written in it, HIST_NO_BLOCK till first sample */
+static uint32_t		last_t;		/* Last sample, in intervals */
+static uint16_t		last_bat;
+static int8_t		last_temp;
+
+
+static uint8_t crc8(const uint8_t *buf, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while(len--) {
+		crc = _crc_ibutton_update(crc, *buf++);
+	}
+	return crc;
+}
+
+
+/* Find the newest block. Logging always resumes in a new block */
+void hist_init(void)
+{
+	uint8_t hdr[HIST_HDR_SIZE];
+	uint8_t b;
+	bool found = false;
+
+	blk = EE_HIST_BLOCKS - 1;
+	seq = 0xFF;
+	for(b = 0; b < EE_HIST_BLOCKS; b++) {
+		eeprom_read_block(hdr, BLOCK_ADDR(b), HIST_HDR_SIZE);
+		if(crc8(hdr, HIST_HDR_SIZE - 1) != hdr[HIST_HDR_SIZE - 1]) {
+			continue;
+		}
+		if(!found || ((int8_t)(hdr[0] - seq) > 0)) {
+			found = true;
+			blk = b;
+			seq = hdr[0];
+		}
+	}
+	count = HIST_NO_BLOCK;
+}
+
+
+/* Call once a minute */
+bool hist_due(uint32_t minute)
+{
+	return (0 == (minute % HIST_INTERVAL_MIN));
+}
+
+
+static void new_block(uint32_t t, uint16_t bat, int8_t temp)
+{
+	uint8_t hdr[HIST_HDR_SIZE];
+	uint8_t *addr;
+	uint8_t i;
+
+	if(++blk >= EE_HIST_BLOCKS) {
+		blk = 0;
+	}
+	seq++;
+	addr = BLOCK_ADDR(blk);
+
+	/* Clear old deltas before the header makes the block valid */
+	for(i = HIST_HDR_SIZE; i < EE_HIST_BLOCK_SIZE; i++) {
+		eeprom_update_byte(addr + i, HIST_END);
+	}
+	hdr[0] = seq;
+	hdr[1] = (uint8_t)t;
+	hdr[2] = (uint8_t)(t >> 8);
+	hdr[3] = (uint8_t)(t >> 16);
+	hdr[4] = HIST_INTERVAL_MIN;
+	hdr[5] = (uint8_t)bat;
+	hdr[6] = (uint8_t)(bat >> 8);
+	hdr[7] = (uint8_t)temp;
+	hdr[8] = crc8(hdr, HIST_HDR_SIZE - 1);
+	eeprom_update_block(hdr, addr, HIST_HDR_SIZE);
+	count = 0;
+}
+
+
+/* Log a sample: bat in 5mV, temp in 0.5 degC */
+void hist_add(uint32_t minute, uint16_t bat, int8_t temp)
+{
+	uint32_t t = minute / HIST_INTERVAL_MIN;
+	int16_t dbat = (int16_t)(bat - last_bat);
+	int8_t dtemp = temp - last_temp;
+
+	if((count < HIST_DELTAS) && (t == last_t + 1) &&
+		(dbat >= -8) && (dbat <= 7) && (dtemp >= -7) && (dtemp <= 7)) {
+		eeprom_update_byte(BLOCK_ADDR(blk) + HIST_HDR_SIZE + count,
+				(uint8_t)(((dbat + 8) << 4) | (dtemp + 7)));
+		count++;
+	}
+	else {
+		new_block(t, bat, temp);
+	}
+	last_t = t;
+	last_bat = bat;
+	last_temp = temp;
+}
+
+#endif /* CONFIG_HISTORY */
@@ -0,0 +1,28 @@
+/*
+ * history.h
+ *
+ *	Battery and temperature history log in EEPROM
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+
+#define HIST_INTERVAL_MIN	60		/* Minutes between samples (2 to 255) */
+
+
+/************ Function declarations *************/
+
+void hist_init(void);
+bool hist_due(uint32_t minute);
+void hist_add(uint32_t minute, uint16_t bat, int8_t temp);
+
+
+#endif /* HISTORY_H_ */
@@ -17,28 +17,181 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <avr/sleep.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include <stdbool.h>
 #include <util/delay.h>
 #include <string.h>
 
+#include "config.h"
 #include "board.h"
-#include "avr_twi.h"
 #include "tm1637.h"
-#include "ds3231.h"
+#include "rtc.h"
 #include "adc.h"
-
-
-/***** CONFIGURATIONS ******/
-
-#define CONFIG_24HR_FORMAT	0		// Define to 1 for 00-23 hour display */
-
+#include "stopwatch.h"
+#include "cdtimer.h"
+#include "console.h"
+#include "settings.h"
+#include "calendar.h"
+#include "history.h"
+#include "fuelgauge.h"
+#include "energy.h"
+#include "power.h"
+#include "disp.h"
+#include "boot.h"
+#include "pt.h"
+#include "eeprom_map.h"
+
+
+/***** CONFIGURATIONS (see config.h) ******/
 
 #define LDR_VAL1		50
 #define LDR_VAL2		90
 #define LDR_VAL3		140
 #define LDR_VAL4		200
 
+/* DS3231 converts temperature every 64 seconds, BSY is set while it does */
+#define TEMP_MAX_AGE		64		/* Seconds */
+
+/* Quiet hours: display stays on this long after a button press */
+#define QUIET_WAKE_SECS		5
+
+/* RTC ticks only when something is due (tick_sleep()): quiet hours with
+ * the display dark, and economy with the time shown */
+#define TICK_SLEEP			(CONFIG_QUIET_HOURS || CONFIG_POWER_PROFILES)
+
+ /* Timer0 is the low rate tick for button sampling and buzzer gating.
+  * Prescaler is picked from F_CPU to keep the overflow period between 8 and 16ms
+  * (8.192ms at 8MHz and 2MHz, 16.384ms at 4MHz and 1MHz) */
+#if F_CPU >= 4000000UL
+#define T0_PRESCALER		((1 << CS02))
+#define T0_DIV				256UL
+#else
+#define T0_PRESCALER		((1 << CS01)|(1 << CS00))
+#define T0_DIV				64UL
+#endif
+/* With only a display animation step to time (edit blink, alarm flash),
+ * Timer0 runs at the slowest prescaler, each overflow counting this many
+ * ticks, and the last ones at the normal rate */
+#define T0_SLOW_PRESCALER	((1 << CS02)|(1 << CS00))
+#define T0_SLOW_TICKS		((uint8_t)(1024UL / T0_DIV))
+#define T0_TICK_US			((T0_DIV * 256UL * 1000UL) / (F_CPU / 1000UL))
+#define T0_TICKS(ms)		((uint8_t)(((uint32_t)(ms) * 1000UL + T0_TICK_US / 2) / T0_TICK_US))
+
+/* RTC tick from Timer0 while the RTC is in fault mode (INT/SQW then stays
+ * low, or does not tick at all). Only as good as the MCU clock */
+#define T0_RTC_TICKS		T0_TICKS(1000)
+
+/* Button engine timing, sampled on the Timer0 tick */
+#define BTN_LONG_TICKS		T0_TICKS(820)	/* Hold time for long press */
+#define BTN_GAP_TICKS		T0_TICKS(250)	/* Max gap between clicks of a multi-click */
+#define BTN_REPEAT_DELAY	T0_TICKS(400)	/* Hold time before first auto-repeat */
+#define BTN_REPEAT_START	T0_TICKS(200)	/* First auto-repeat interval */
+#define BTN_REPEAT_MIN		T0_TICKS(40)	/* Fastest auto-repeat interval */
+
+#if (820000UL / T0_TICK_US) > 255 || (40000UL / T0_TICK_US) < 1
+#error "Timer0 tick does not fit the button timings at this F_CPU"
+#endif
+
+/* Display animation timing (see disp.c), also on the Timer0 tick */
+#define BLINK_EDIT_TICKS	T0_TICKS(500)	/* Half period of field being edited */
+#define BLINK_ALARM_TICKS	T0_TICKS(250)	/* Half period of time flashing on alarm */
+#define ROLL_STEP_TICKS		T0_TICKS(60)	/* Roll of digits changing on minute change */
+
+/* Button engine modes */
+#define BTN_MODE_MULTI		0x01	/* Wait for double/triple clicks before reporting a click */
+#define BTN_MODE_REPEAT		0x02	/* Holding repeats instead of giving long press */
+
+#if !BOARD_HAS_BUTTON && !CONFIG_CONSOLE
+#error "Board without button needs CONFIG_CONSOLE for setting up"
+#endif
+
+/* Button events */
+#define BTN_NONE			0
+#define BTN_CLICK1			1
+#define BTN_CLICK2			2
+#define BTN_CLICK3			3
+#define BTN_LONG			4
+#define BTN_REPEAT			5
+#define EV_TICK				0xFF	/* Not a button event: 1 second tick to UI flows */
+
+/* show_field() flags */
+#define SHOW_BLINK_L		0x01	/* Blink left pair of digits */
+#define SHOW_BLINK_R		0x02
+#define SHOW_ZERO			0x04	/* Leading zeros */
+#define SHOW_COLON			0x08
+
+/* Edit a field in a UI flow: show it on every event, and step it on button
+ * events till a long press (double click in repeat mode) moves on */
+#define FLOW_FIELD(render, step)	\
+	do {	\
+		render;	\
+		PT_YIELD_UNTIL(&flow_pt, BTN_NONE != flow_ev);	\
+		if((EV_TICK != flow_ev) && !long_press) {	\
+			step;	\
+		}	\
+	} while((EV_TICK == flow_ev) || !long_press)
+
+#define FLOW_WAIT_BUTTON()	PT_YIELD_UNTIL(&flow_pt, (BTN_NONE != flow_ev) && (EV_TICK != flow_ev))
+
+/* Buzzer pattern segments: bit 7 set for tone, bits 6:0 length in Timer0 ticks.
+ * A zero entry ends the pattern, which then repeats from the start */
+#define BUZZ_TONE(ms)		(0x80 | T0_TICKS(ms))
+#define BUZZ_GAP(ms)		(T0_TICKS(ms))
+#define BUZZ_END			0
+#define BUZZER_MA			30		/* Extra battery current with buzzer on */
+
+/* Tone half period is 150us (~3.3kHz) : Timer2 CTC at F_CPU/8 */
+#define TONE_HALF_US		150
+#define T2_PRESCALER		((1 << CS21))
+#define T2_TONE_OCR			((uint8_t)(((F_CPU / 8UL) * TONE_HALF_US + 500000UL) / 1000000UL - 1))
+
+#if ((F_CPU / 8UL) * TONE_HALF_US / 1000000UL) > 256
+#error "Tone half period does not fit Timer2 at this F_CPU"
+#endif
+
+/* ADC clock must be within 50-200kHz for full resolution */
+#if F_CPU > 12800000UL
+#define ADC_PRESCALER		ADC_PRESCALER_128
+#elif F_CPU > 6400000UL
+#define ADC_PRESCALER		ADC_PRESCALER_64
+#elif F_CPU > 3200000UL
+#define ADC_PRESCALER		ADC_PRESCALER_32
+#elif F_CPU > 1600000UL
+#define ADC_PRESCALER		ADC_PRESCALER_16
+#else
+#define ADC_PRESCALER		ADC_PRESCALER_8
+#endif
+
+/* Boot time to first frame (target < 30ms) is measured with Timer1 at F_CPU/64 from
+ * main() entry. Hardware start-up (reset delay and oscillator start, set by SUT/CKSEL
+ * fuses) comes before that: 16K CK + 4.1ms (~6ms) with the crystal fuses and
+ * 6 CK + 4.1ms with the internal RC fuses (see CLOCK in Makefile) */
+#define BOOT_TICK_US		(64000000UL / F_CPU)
+#define BOOT_TARGET_MS		30
+#define BOOT_STARTUP_MS		6		/* Hardware start-up, not measured */
+#define BOOT_TARGET_TICKS	((BOOT_TARGET_MS - BOOT_STARTUP_MS) * 1000UL / BOOT_TICK_US)
+#define BOOT_SLOW_LED_S		4		/* LED self test this long if over target (else till first tick) */
+
+/* Worst case ISR cycle counts (vector entry + prologue + body + reti), checked
+ * against the built image with 'make isr-budget' (tools/isr_budget.py reads
+ * these and fails on any ISR in the image without one). Measured with the
+ * tool on -Os builds of both boards, all options on and off, at 8 and 1MHz
+ * (largest of these), compiled with LLVM as avr-gcc was not at hand: re-run
+ * the check on an avr-gcc build and after changing a handler.
+ * No handler nests (ISR_NOBLOCK): Timer0 and INT0/INT1 both read-modify-write
+ * GICR and TCCR0, and the only short deadline, the Timer2 tone (150us), waits
+ * at most for Timer0: 27us at 8MHz. At 1MHz that is 216us, so a half period
+ * of the tone stretches now and then, which is left as is */
+#define ISR_BUDGET_INT0			41
+#define ISR_BUDGET_INT1			35
+#define ISR_BUDGET_TIMER0_OVF	216		/* v1, 163 on v2 (no button) */
+#define ISR_BUDGET_TIMER2_COMP	15
+#define ISR_BUDGET_TIMER1_OVF	43		/* stopwatch.c */
+#define ISR_BUDGET_TIMER1_COMPB	59		/* stopwatch.c */
+#define ISR_BUDGET_USART_RXC	71		/* console.c */
+#define ISR_BUDGET_ADC			10		/* adc.c, reti only: exact */
+
 #define DOW_SUN 		{0x6D, 0x1C, 0x54, 0}
 #define DOW_MON			{0x33, 0x27, 0x5C, 0x54}
 #define DOW_TUE			{0x78, 0x3E, 0x79, 0}
@@ -54,6 +207,12 @@ typedef enum _dispStates {
 	DISP_DOW,
 	DISP_DATE,
 	DISP_MONTH,
+	DISP_TEMP,
+	DISP_BAT,
+#if CONFIG_ENERGY
+	DISP_ENERGY,		/* Hidden: long press on DISP_BAT */
+	DISP_RUNTIME,
+#endif
 	DISP_ALARM,
 	DISP_EDIT,
 	DISP_TIMER_INIT,
@@ -61,118 +220,303 @@ typedef enum _dispStates {
 //	DISP_TIMER_HHMM,
 	DISP_CDT_INIT,
 	DISP_CDT_MMSS,
+#if CONFIG_STOPWATCH
+	DISP_SW_INIT,
+	DISP_SW,
+	DISP_SW_LAP,
+#endif
 } dispState_t;
 
 
-typedef enum _editStates {
-	EDIT_ALARM_INIT = 0,
-	EDIT_ALARM_MIN,
-	EDIT_ALARM_HOUR,
-	EDIT_ALARM_SET,
-	EDIT_TIME_INIT,
-	EDIT_TIME_MIN,
-	EDIT_TIME_HOUR,
-	EDIT_TIME_DATE,
-	EDIT_TIME_MONTH,
-	EDIT_TIME_YEAR,
-	EDIT_TIME_SET,
-	EDIT_CDT_SEC,
-	EDIT_CDT_MIN,
-	EDIT_CDT_HOUR
-} editState_t;
-
-
 typedef struct _timer_t {
 	uint8_t sec;
 	uint8_t min;
 	uint8_t hour;
-	bool paused;
-	bool set;
-	bool expired;
 } timer_t;
 
+typedef char (*flow_t)(void);
+
 
 /* GLOBAL VARIABLES */
-static ds3231_time_t 		g_time, e_time;
+static ds3231_time_t 		g_time;
 static ds3231_alarm_t		g_alarm;
-static timer_t				inc_timer = {.paused = true};
-static timer_t				cd_timer = {.paused = true};
-static timer_t 				bkp_timer = {.paused = true};
+static timer_t 				bkp_timer;		/* Countdown preset */
+static uint8_t				cdt_sel = CDT_NONE;				/* Countdown timer shown */
+static uint8_t				brightness;
+static int16_t				rtc_temp;		/* Cached DS3231 temperature in 0.25 degC */
+static uint8_t				temp_age = TEMP_MAX_AGE;	/* Seconds since rtc_temp read */
+static bool					temp_valid;
+static uint16_t				vbg_cal;		/* Calibrated bandgap voltage (mV), 0 if not calibrated */
+static uint16_t				boot_ticks;		/* Time to first frame in BOOT_TICK_US (read with debugger/simavr) */
+static uint8_t				led_test = 1;	/* RTC ticks left of LED self test */
+static bool					fmt24 = CONFIG_24HR_FORMAT;
 static bool					alarm_on;
 static bool					buzzer_on;
 static uint8_t 				idle;
+#if CONFIG_QUIET_HOURS
+static uint8_t				quiet_start = QUIET_OFF;	/* Quiet hours (BCD), start QUIET_OFF if none */
+static uint8_t				quiet_end;
+static uint8_t				wake_secs;		/* Seconds left of display shown by a button in quiet hours */
+#endif
+#if TICK_SLEEP
+static bool					tick_sleeping;	/* RTC ticks only at the next thing due (tick_sleep()) */
+static uint32_t				sleep_since;	/* rtc_seconds() at last tick before */
+#endif
+static bool					dark;			/* Display blanked for quiet hours */
+static bool					dst;			/* Daylight saving time: g_time is RTC time plus an hour */
+static bool					eco;			/* Economy power profile, on battery */
+#if CONFIG_STOPWATCH
+static uint32_t				sw_lap;
+#endif
 static volatile bool 		rtc_flag;
-static volatile bool 		long_press;
-static volatile bool		button_flag;
-static volatile bool 		no_sleep;
-static volatile uint16_t 	button_samp;
+#if BOARD_HAS_BUTTON
+static bool 				long_press;
+static volatile uint8_t		button_event;
+static volatile uint8_t		button_mode;
+#endif
+static volatile bool 		btn_sampling;	/* Button sampled on Timer0 tick */
+static const uint8_t * volatile buzz_seg;	/* Current buzzer pattern segment, NULL when off */
+static const uint8_t		*buzz_pattern;
+static volatile uint8_t		buzz_ticks;
+static volatile uint8_t		anim_ticks;		/* Timer0 ticks to next display animation step */
+static volatile bool		anim_due;
+static volatile uint8_t		tick_ticks;		/* Timer0 ticks to next RTC tick in fault mode, 0 if not */
+
+#if BOARD_HAS_BUTTON
+/* UI flow running in DISP_EDIT (see pt.h), and its state */
+static flow_t				flow;
+static pt_t					flow_pt;
+static uint8_t				flow_ev;		/* Event being handled */
+static uint8_t				flow_btn;		/* Button engine mode wanted */
+static dispState_t			flow_next;		/* Display state once flow ends */
+static union {
+	ds3231_time_t time;		/* Time being set */
+	timer_t cdt;			/* Countdown being set */
+} fl;
+#endif
 static uint8_t dow_arr[][4] = { DOW_SUN, DOW_MON, DOW_TUE, DOW_WED, DOW_THU, DOW_FRI, DOW_SAT};
-static uint8_t tm[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};  /* Table for day of week calculation */
+
+/* Display brightness levels selectable from console */
+static const uint8_t bright_arr[] PROGMEM = {
+	TM1637_DISPLAY_PW_1_16, TM1637_DISPLAY_PW_2_16, TM1637_DISPLAY_PW_4_16, TM1637_DISPLAY_PW_10_16
+};
+
+/* Approximate battery current (mA) at each brightness, for fuel gauge load compensation */
+static const uint8_t bright_ma[] PROGMEM = { 6, 9, 15, 34 };
+
+/* 4 beeps of 75ms then 750ms silence */
+static const uint8_t buzz_alarm[] PROGMEM = {
+	BUZZ_TONE(75), BUZZ_GAP(75), BUZZ_TONE(75), BUZZ_GAP(75),
+	BUZZ_TONE(75), BUZZ_GAP(75), BUZZ_TONE(75), BUZZ_GAP(750),
+	BUZZ_END
+};
+
+/* Countdown timer expiry: number of beeps tells which timer expired */
+static const uint8_t buzz_cdt[CDT_MAX][9] PROGMEM = {
+	{ BUZZ_TONE(150), BUZZ_GAP(600), BUZZ_END },
+	{ BUZZ_TONE(150), BUZZ_GAP(150), BUZZ_TONE(150), BUZZ_GAP(600), BUZZ_END },
+	{ BUZZ_TONE(150), BUZZ_GAP(150), BUZZ_TONE(150), BUZZ_GAP(150),
+	  BUZZ_TONE(150), BUZZ_GAP(600), BUZZ_END },
+	{ BUZZ_TONE(150), BUZZ_GAP(150), BUZZ_TONE(150), BUZZ_GAP(150),
+	  BUZZ_TONE(150), BUZZ_GAP(150), BUZZ_TONE(150), BUZZ_GAP(600), BUZZ_END },
+};
 
 /* PRIVATE FUNCTIONS */
 static void avr_init(void);
 static bool check_lowbattery(void);
 static void display(dispState_t state);
-static void edit(editState_t state);
-static void buzzer(bool on);
-static uint8_t increment_bcd(uint8_t bcd);
+static void show_text(uint8_t c0, uint8_t c1, uint8_t c2, uint8_t c3, uint8_t dot_pos);
+#if BOARD_HAS_BUTTON
+static void show_field(uint8_t left, uint8_t right, uint8_t flags);
+static dispState_t flow_start(flow_t fn);
+static dispState_t flow_run(uint8_t ev);
+static char flow_alarm(void);
+static char flow_time(void);
+static char flow_cdt(void);
+#endif
+static void buzzer(const uint8_t *pattern);
+static void anim_run(uint8_t ticks);
+static void t0_run(void);
+static bool event_pending(void);
+#if CONFIG_QUIET_HOURS
+static bool quiet_hours(uint8_t hour);
+static void display_off(void);
+#endif
+#if TICK_SLEEP
+static uint32_t day_seconds(uint8_t hour, uint8_t min, uint8_t sec);
+static uint32_t day_until(uint32_t t, uint32_t at);
+static void tick_sleep(uint32_t secs);
+static bool tick_wake(void);
+#endif
+#if BOARD_HAS_BUTTON
+static uint8_t button_mode_for(dispState_t disp);
+#endif
+static void restore_settings(void);
+static void save_settings(void);
+static void update_temp(uint8_t status, uint8_t secs);
+static uint8_t bright_level(void);
+#if CONFIG_POWER_PROFILES
+static void power_profile(bool economy);
+#endif
+#if CONFIG_HISTORY
+static void log_history(uint32_t now);
+#endif
+#if CONFIG_CONSOLE
+static void console_apply(console_cmd_t *cmd);
+#endif
+#if CONFIG_BOOTLOADER
+static void boot_request(void);
+#endif
 static uint8_t bcd2bin8(uint8_t bcd);
 static uint8_t bin2bcd8(uint8_t bin);
+#if BOARD_HAS_BUTTON
+static uint8_t increment_bcd(uint8_t bcd);
 static uint8_t increment_minute(uint8_t minute);
 static uint8_t increment_hour(uint8_t hour);
 static uint8_t increment_date(uint8_t date);
 static uint8_t increment_month(uint8_t month);
 static uint8_t increment_year(uint8_t year);
-static void increment_timer(timer_t *tim);
-static bool decrement_timer(timer_t *tim);
-static uint8_t dayofweek(uint8_t date, uint8_t month, uint16_t year);
+#endif
+static void seconds_to_timer(uint32_t secs, timer_t *tim);
+static uint32_t rtc_seconds(void);
 
 /*  MAIN  */
 int main(void)
 {
 	uint8_t rtc_status;
 	uint8_t elapsed = 0;
+	uint8_t id;
+	uint32_t now;
+#if BOARD_HAS_BUTTON
+	uint8_t ev;
+#endif
+	bool cdt_ringing = false;
 	bool low_bat = false;
+	bool time_ok;
+	bool tick = false;
+	bool woke = false;
+#if CONFIG_CONSOLE
+	console_cmd_t cmd;
+#endif
 	dispState_t dispState = DISP_HHMM;
-	editState_t editState = EDIT_ALARM_INIT;
 
 	avr_init();
-	ds3231_read_alarm2(&g_alarm, &alarm_on);
-	tm1637_set_brightness(TM1637_DISPLAY_PW_1_16);
-	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	disp_init(ROLL_STEP_TICKS);
+	restore_settings();
+#if CONFIG_POWER_PROFILES
+	power_profile(true);  /* On battery till the fuel gauge tells otherwise */
+#else
+	tm1637_set_brightness(pgm_read_byte(&bright_arr[brightness]));
+#endif
+
+	/* Show time right away instead of waiting for the first RTC tick. The
+	 * DS3231 is set up in the same transfer */
+	time_ok = !rtc_read_first(&g_time, &rtc_status) && !(rtc_status & RTC_STATUS_OSF) && !rtc_fault();
+#if CONFIG_DST
+	dst = cal_dst_local(&g_time);
+#endif
+	display(dispState);
+	cdt_restore(rtc_seconds(), time_ok);  /* Resume timers running before reset, paused if time was lost */
+#if CONFIG_HISTORY
+	hist_init();
+#endif
+	boot_ticks = TCNT1;
+	if(boot_ticks > BOOT_TARGET_TICKS) {
+		led_test = BOOT_SLOW_LED_S;  /* Seen at power up */
+	}
+	power_init();  /* Timer1 now counts awake time */
 
 	while(1)
 	{
 
 		if(rtc_flag) {
 			rtc_flag = false;
-			ds3231_read_status(&rtc_status);
-
-			ds3231_read_time(&g_time);   /* Read time from RTC */
-			if(!inc_timer.paused) {  /* Increment Timer */
-				increment_timer(&inc_timer);
+			tick = true;
+			woke = false;
+#if TICK_SLEEP
+			if(tick_sleeping) {  /* No tick till back on the 1Hz tick, time is read again then */
+				rtc_wait_tick();
+				tick = woke = tick_wake();
 			}
-			if((!cd_timer.paused) && cd_timer.set) {
-				cd_timer.expired = decrement_timer(&cd_timer);
-				if(cd_timer.expired) {
-					idle = 0;
-					elapsed = 0;
-					cd_timer.set = false;
-					dispState = DISP_CDT_MMSS;
-					buzzer_on = true;  // prevent sleep
-					buzzer(true);
+#endif
+		}
+
+		if(tick) {
+			tick = false;
+			if(!woke) {
+				rtc_tick();
+				rtc_read_status(&rtc_status);  /* Ends the tick on INT/SQW */
+				rtc_local_time(&g_time);
+				if(!eco || !g_time.sec) {  /* Economy: RTC read once a minute, counted on its tick between */
+					update_temp(rtc_status, eco ? 60 : 1);
+
+					rtc_read_time(&g_time);   /* Read time from RTC, kept locally if it fails */
 				}
 			}
-			if(cd_timer.expired) {
+#if CONFIG_DST
+			dst = cal_dst_local(&g_time);
+#endif
+			power_tick();
+#if CONFIG_ENERGY
+			energy_tick(dark ? EN_DISP_OFF : bright_level(), buzzer_on);
+#endif
+			if(led_test && !--led_test) {  /* End of LED self test */
+				LED_OFF();
+			}
+#if CONFIG_CONSOLE
+			console_tick();
+#endif
+			if(0 == g_time.sec) {  /* Timers run on RTC time line, correct once a minute */
+				now = rtc_seconds();
+				cdt_sync(now);
+#if CONFIG_HISTORY
+				log_history(now);
+#endif
+#if CONFIG_CONSOLE
+				console_listen();
+#endif
+			}
+			else if(!woke) {
+				cdt_tick();
+			}
+			if(cdt_ringing) {
 				if(++elapsed > 2) {
-					cd_timer.expired = false;
+					cdt_ringing = false;
 					dispState = DISP_HHMM;
-					buzzer_on = false;  // can sleep now
-					buzzer(false);
+					buzzer_on = false;  // Power down again once Timer0 stops
+					buzzer(NULL);
 				}
 			}
+			else if((id = cdt_expired()) != CDT_NONE) {  /* Only queue head is checked */
+				idle = 0;
+				elapsed = 0;
+				cdt_sel = id;
+				cdt_ringing = true;
+				dispState = DISP_CDT_MMSS;
+				buzzer_on = true;  // Idle mode sleep only while Timer0 runs
+				buzzer(buzz_cdt[id]);
+			}
 
-			if(dispState != DISP_EDIT) {
+#if BOARD_HAS_BUTTON
+			if(DISP_EDIT == dispState) {
+				dispState = flow_run(EV_TICK);
+			}
+#endif
+#if CONFIG_QUIET_HOURS
+			if(wake_secs) {
+				--wake_secs;
+			}
+			if(!quiet_hours(g_time.hour) || buzzer_on) {  /* Alarm or timer ringing shows up */
+				dark = false;
+			}
+			else if(!dark && !wake_secs && (DISP_EDIT != dispState)) {
+				dark = true;
+				dispState = DISP_HHMM;
+				idle = 0;
+				display_off();
+			}
+#endif
+			if(!dark && (dispState != DISP_EDIT)) {
 				if(DISP_HHMM == dispState) {
 					if(idle < 10) ++idle;
 				}
@@ -185,53 +529,113 @@ int main(void)
 				}
 				display(dispState);
 			}
-			else {
-				edit(editState);
-			}
 
 			if(alarm_on && (g_alarm.hour == g_time.hour) && (g_alarm.min == g_time.min) && ((g_alarm.sec == g_time.sec))) {  /* DS3231 Alarm2 A2F flag will not set so, check we for Alarm match here */
 				if(!buzzer_on) {
-					buzzer_on = true;  // prevent sleep
+					buzzer_on = true;  // Idle mode sleep only while Timer0 runs
 					idle = 0;
 					elapsed = 0;
 					dispState = DISP_ALARM;
-					buzzer(true); /* Start buzzer tone */
+					buzzer(buzz_alarm); /* Start buzzer tone */
 				}
 			}
 			else {
 				if(buzzer_on) {
 					if(++elapsed > 30) {
-						buzzer_on = false;   // can sleep now
-						buzzer(false);
+						buzzer_on = false;   // Power down again once Timer0 stops
+						buzzer(NULL);
 						dispState = DISP_HHMM;
 					}
 				}
 			}
 
-			if(!(g_time.sec & 0xF)) { /* Sample battery voltage every 10 sec */
-				low_bat = check_lowbattery();
+			low_bat = check_lowbattery();
+#if CONFIG_POWER_PROFILES
+			if(fg_external() == eco) {
+				power_profile(!fg_external());
+				if(!dark && (DISP_EDIT != dispState)) {
+					display(dispState);
+				}
 			}
+#endif
 
 			if(low_bat && !(g_time.sec & 0x1)) { /* Every 2 sec issue low battery indication */
 				LED_ON();
 				_delay_ms(40);
 				LED_OFF();
 			}
+			if(rtc_fault() && (g_time.sec & 0x1)) {  /* RTC not answering, time kept locally: flash on odd seconds */
+				LED_ON();
+				_delay_ms(40);
+				LED_OFF();
+			}
+#if CONFIG_QUIET_HOURS
+			if(dark) {
+				tick_sleep(day_until(day_seconds(g_time.hour, g_time.min, g_time.sec), day_seconds(quiet_end, 0, 0)));
+			}
+#endif
+#if CONFIG_POWER_PROFILES
+			if(!tick_sleeping && eco && (DISP_HHMM == dispState) && (10 == idle) && !buzzer_on && !cdt_ringing && !low_bat && !led_test) {
+				tick_sleep(60 - bcd2bin8(g_time.sec));  /* Economy: time only, next minute */
+			}
+#endif
+
+		}
+
+		if(anim_due) {
+			anim_due = false;
+			anim_run(disp_step());
+		}
+
+#if CONFIG_CONSOLE
+		if(console_read(&cmd)) {
+			console_apply(&cmd);
+			if(!dark && (DISP_EDIT != dispState)) {
+				display(dispState);
+			}
+		}
+#endif
 
+#if CONFIG_STOPWATCH
+		if(sw_refresh_pending() && (DISP_SW == dispState)) {
+			display(dispState);
 		}
+#endif
 
-		if(button_flag) {
-			button_flag = false;
-			if(!long_press) {
-				no_sleep = false;
+#if BOARD_HAS_BUTTON
+		if(button_event) {
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				ev = button_event;
+				button_event = BTN_NONE;
+			}
+			if(button_mode & BTN_MODE_REPEAT) {  /* Value editing: repeat steps, double click moves on */
+				long_press = (BTN_CLICK2 == ev) || (BTN_CLICK3 == ev);
+			}
+			else {
+				long_press = (BTN_LONG == ev);
 			}
 
 			idle = 0;
-			switch (dispState) {
+#if CONFIG_QUIET_HOURS
+			wake_secs = QUIET_WAKE_SECS;
+#endif
+#if TICK_SLEEP
+			tick_wake();  /* Back on the 1Hz tick */
+#endif
+			if(dark) {  /* Press only wakes the display */
+				dark = false;
+				dispState = DISP_HHMM;
+			}
+			else switch (dispState) {
 			case DISP_HHMM:
 				if(long_press) {
-					dispState = DISP_EDIT;
-					editState = EDIT_ALARM_INIT;
+					dispState = flow_start(flow_alarm);
+				}
+				else if(BTN_CLICK2 == ev) {  /* Shortcuts */
+					dispState = DISP_CDT_INIT;
+				}
+				else if(BTN_CLICK3 == ev) {
+					dispState = DISP_TIMER_INIT;
 				}
 				else {
 					dispState = DISP_SS;
@@ -243,17 +647,41 @@ int main(void)
 				break;
 
 			case DISP_DOW:
-				dispState = DISP_DATE;
+				if(long_press) {  /* Toggle 12/24 hour display, shown on the time page */
+					fmt24 = !fmt24;
+					save_settings();
+					dispState = DISP_HHMM;
+				}
+				else {
+					dispState = DISP_DATE;
+				}
 				break;
 
 			case DISP_DATE:
-				dispState = (long_press) ? DISP_MONTH : DISP_HHMM;
+				dispState = (long_press) ? DISP_MONTH : DISP_TEMP;
+				break;
+
+			case DISP_TEMP:
+				dispState = DISP_BAT;
+				break;
+
+			case DISP_BAT:
+#if CONFIG_ENERGY
+				dispState = (long_press) ? DISP_ENERGY : DISP_HHMM;
+				break;
+
+			case DISP_ENERGY:
+				dispState = DISP_RUNTIME;
+				break;
+
+			case DISP_RUNTIME:
+#endif
+				dispState = DISP_HHMM;
 				break;
 
 			case DISP_MONTH:
 				if(long_press) {
-					dispState = DISP_EDIT;
-					editState = EDIT_TIME_INIT;
+					dispState = flow_start(flow_time);
 				}
 				else {
 					dispState = DISP_HHMM;
@@ -262,21 +690,24 @@ int main(void)
 
 			case DISP_TIMER_INIT:
 				if(long_press) {
+#if CONFIG_STOPWATCH
+					dispState = DISP_SW_INIT;
+#else
 					dispState = DISP_CDT_INIT;
+#endif
 				}
 				else {
-					inc_timer.paused = false;
+					upt_start();
 					dispState = DISP_TIMER_MMSS;
 				}
 				break;
 
 			case DISP_TIMER_MMSS:
 				if(long_press) {
-					if(inc_timer.paused) {
-						bkp_timer = inc_timer;  // Save current timer value for CDT
-						inc_timer.hour = 0;
-						inc_timer.min = 0;
-						inc_timer.sec = 0;
+					if(!upt_running()) {
+						seconds_to_timer(upt_elapsed(), &bkp_timer);  // Save current timer value for CDT
+						save_settings();
+						upt_clear();
 						dispState = DISP_TIMER_INIT;
 					}
 					else {
@@ -284,204 +715,140 @@ int main(void)
 					}
 				}
 				else {
-					inc_timer.paused = !inc_timer.paused;
+					if(upt_running()) {
+						upt_pause();
+					}
+					else {
+						upt_start();
+					}
 				}
 				break;
 
-			case DISP_CDT_INIT:
+#if CONFIG_STOPWATCH
+			case DISP_SW_INIT:
 				if(long_press) {
-					dispState = DISP_HHMM;
+					dispState = DISP_CDT_INIT;
 				}
 				else {
-					if(!cd_timer.set) {
-						cd_timer = bkp_timer;
-						dispState = DISP_EDIT;
-						editState = EDIT_CDT_SEC;
-					}
-					else {
-						dispState = DISP_CDT_MMSS;
+					if(!sw_running() && !sw_read()) {
+						sw_start();
 					}
+					dispState = DISP_SW;
 				}
 				break;
 
-			case DISP_CDT_MMSS:
+			case DISP_SW:
 				if(long_press) {
-					if(cd_timer.paused) {  /* Reset CDT */
-						cd_timer = bkp_timer;
-						dispState = DISP_EDIT;
-						editState = EDIT_CDT_SEC;
+					if(sw_running()) {
+						sw_stop();
 					}
-					else {
+					else {  /* Reset stopwatch */
+						sw_reset();
 						dispState = DISP_HHMM;
 					}
 				}
 				else {
-					cd_timer.paused = !cd_timer.paused;
+					if(sw_running()) {  /* Capture lap */
+						sw_lap = sw_read();
+						dispState = DISP_SW_LAP;
+					}
+					else {
+						sw_start();
+					}
 				}
 				break;
 
-			case DISP_ALARM:
-				dispState = DISP_HHMM;
-				buzzer_on = false;  // if false, would be set true again at the alarm match check
-				buzzer(false);
+			case DISP_SW_LAP:
+				if(long_press) {
+					sw_stop();
+				}
+				dispState = DISP_SW;
 				break;
+#endif
 
-			case DISP_EDIT:
-				switch(editState) {
-				case EDIT_ALARM_INIT:
-					if(long_press) {
-						if(alarm_on) {
-							if(!ds3231_alarm2_onoff(ALARM_OFF)) {
-								alarm_on = false;
-							}
-						}
-						else {
-							dispState = DISP_HHMM;
-						}
-					}
-					else {
-						editState = EDIT_ALARM_MIN;
-						alarm_on = false; // Prevent alarm going off during set up
-					}
-					break;
-
-				case EDIT_ALARM_MIN:
-					if(long_press) {
-						editState = EDIT_ALARM_HOUR;
-					}
-					else {
-						g_alarm.min = increment_minute(g_alarm.min);
-					}
-					break;
-
-				case EDIT_ALARM_HOUR:
-					if(long_press) {
-						editState = EDIT_ALARM_SET;
-						g_alarm.day_date = g_time.date; // Day/Date is irrelevant for DAILY alarm type */
-						ds3231_set_alarm2(&g_alarm, ALARM_DAILY);
-						if(!ds3231_alarm2_onoff(ALARM_ON)) {
-							alarm_on = true;
-						}
+			case DISP_CDT_INIT:
+				if(long_press) {
+					if(cdt_count() && (cdt_alloc() != CDT_NONE)) {  /* Set up another timer */
+						cdt_sel = CDT_NONE;
+						dispState = flow_start(flow_cdt);
 					}
 					else {
-						g_alarm.hour = increment_hour(g_alarm.hour);
-					}
-					break;
-
-				case EDIT_ALARM_SET:
-				case EDIT_TIME_SET:
-					dispState = DISP_HHMM;
-					break;
-
-				case EDIT_TIME_INIT:
-					if(long_press) {
 						dispState = DISP_HHMM;
 					}
-					else {
-						editState = EDIT_TIME_MIN;
-						e_time = g_time;
-					}
-					break;
-
-				case EDIT_TIME_MIN:
-					if(long_press) {
-						editState = EDIT_TIME_HOUR;
-					}
-					else {
-						e_time.min = increment_minute(e_time.min);
-					}
-					break;
-
-				case EDIT_TIME_HOUR:
-					if(long_press) {
-						editState = EDIT_TIME_DATE;
-					}
-					else {
-						e_time.hour = increment_hour(e_time.hour);
-					}
-					break;
-
-				case EDIT_TIME_DATE:
-					if(long_press) {
-						editState = EDIT_TIME_MONTH;
-					}
-					else {
-						e_time.date = increment_date(e_time.date);
-					}
-					break;
-
-				case EDIT_TIME_MONTH:
-					if(long_press) {
-						editState = EDIT_TIME_YEAR;
-					}
-					else {
-						e_time.month = increment_month(e_time.month);
-					}
-					break;
-
-				case EDIT_TIME_YEAR:
-					if(long_press) {
-						editState = EDIT_TIME_SET;
-						e_time.sec = 0;
-						e_time.day = dayofweek(bcd2bin8(e_time.date), bcd2bin8(e_time.month), 2000+bcd2bin8(e_time.year)) + 1;  // Day of week is in the range 1-7
-						ds3231_set_time(&e_time);
-					}
-					else {
-						e_time.year = increment_year(e_time.year);
-					}
-					break;
-
-				case EDIT_CDT_SEC:
-					if(long_press) {
-						editState = EDIT_CDT_MIN;
+				}
+				else {
+					cdt_sel = cdt_soonest();
+					if(CDT_NONE == cdt_sel) {
+						dispState = flow_start(flow_cdt);
 					}
 					else {
-						if(++cd_timer.sec > 59) {
-							cd_timer.sec = 0;
-						}
+						dispState = DISP_CDT_MMSS;
 					}
-					break;
+				}
+				break;
 
-				case EDIT_CDT_MIN:
-					if(long_press) {
-						editState = EDIT_CDT_HOUR;
+			case DISP_CDT_MMSS:
+				if(cdt_ringing) {  /* Any press, long too, stops it ringing */
+					cdt_ringing = false;
+					buzzer_on = false;
+					buzzer(NULL);
+					dispState = DISP_HHMM;
+				}
+				else if(long_press) {
+					if((cdt_sel != CDT_NONE) && cdt_paused(cdt_sel)) {  /* Reset CDT */
+						dispState = flow_start(flow_cdt);
 					}
 					else {
-						if(++cd_timer.min > 59) {
-							cd_timer.min = 0;
-						}
+						dispState = DISP_HHMM;
 					}
-					break;
-
-				case EDIT_CDT_HOUR:
-					if(long_press) { // Start counting down
-						cd_timer.set = true;
-						cd_timer.paused = false;
-						dispState = DISP_CDT_MMSS;
+				}
+				else if(cdt_sel != CDT_NONE) {
+					if(cdt_paused(cdt_sel)) {
+						cdt_resume(cdt_sel);
 					}
 					else {
-						if(++cd_timer.hour > 99) {
-							cd_timer.hour = 0;
-						}
+						cdt_pause(cdt_sel);
 					}
-					break;
 				}
+				break;
+
+			case DISP_ALARM:
+				dispState = DISP_HHMM;
+				buzzer_on = false;  // if false, would be set true again at the alarm match check
+				buzzer(NULL);
+				break;
 
+			case DISP_EDIT:
+				dispState = flow_run(ev);
+				break;
 			}
 
 			if(dispState != DISP_EDIT) {
 				display(dispState);
 			}
-			else {
-				edit(editState);
-			}
 		}
 
-		GICR |= (1 << INT1);
-		if(!no_sleep && !buzzer_on) {
-			sleep_mode();
-			TWI_Reset();
+		button_mode = button_mode_for(dispState);
+
+#endif
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {  /* Timer0 ISR also writes GICR */
+			if(rtc_fault()) {  /* INT/SQW not cleared: tick on Timer0 meanwhile */
+				GICR &= ~(1 << INT1);
+				if(!tick_ticks) {
+					tick_ticks = T0_RTC_TICKS;
+					t0_run();
+				}
+			}
+			else {  /* Low already if a tick is due */
+				tick_ticks = 0;
+				GICR |= (1 << INT1);
+			}
 		}
+		cli();
+		if(!event_pending()) {
+			power_sleep();  /* Deepest mode the running timers allow */
+		}
+		sei();
 	}
 
 	return 0;
@@ -490,67 +857,63 @@ int main(void)
 
 static void avr_init(void)
 {
+	TCCR1B = (1 << CS11)|(1 << CS10);  /* Boot time measurement */
+
 	LED_INIT();
+	LED_ON();  /* Self test, stays on till first RTC tick (or on RTC failure) */
+#if BOARD_HAS_CHRG
 	CHRG_INIT();
+#endif
+#if BOARD_HAS_BUTTON
 	BUTTON_INIT();
+#endif
 
-	LED_ON();
-	_delay_ms(500);
-	LED_OFF();
-
-
-	adc_init(ADC_PRESCALER_64, ADC_VREF_INTERNAL);
-	adc_select_channel(BAT_ADC_CHANNEL);
-	adc_samp();
+	/* ADC is enabled only while the fuel gauge measures */
+	adc_init(ADC_PRESCALER, ADC_VREF_AVCC);
+	ADC_DISABLE();
 
 	/* Buzzer */
-	DDRC |= (1 << PC3);
-	TCCR1A = 0;
-	TCCR1B = 0;
-	OCR1A = 149; /* Interrupt every 150us */
-	TIMSK |= (1 << OCIE1A)|(1 << TOIE0);  /* Enable Timer1 Compare Interrupt and Timer0 overflow interrupt */
+	BUZZER_INIT();
+	TCCR2 = 0;
+	OCR2 = T2_TONE_OCR; /* Interrupt every TONE_HALF_US */
+	TIMSK |= (1 << OCIE2)|(1 << TOIE0);  /* Enable Timer2 Compare Interrupt and Timer0 overflow interrupt */
 
 
 	MCUCR &= ~((1 << ISC11)|(1 << ISC10)|(1 << ISC01)|(1 << ISC00)); /* Low Level INT1 and INT0 (required for Power down mode) */
-	GICR |= (1 << INT1)|(1 << INT0);
-
-	sei();	/* For I2C driver !!*/
-	tm1637_init();
-	if(ds3231_init()) {
-		LED_ON();
-	}
+#if BOARD_HAS_BUTTON
+	GICR |= (1 << INT0);
+#endif
+	/* INT1 is enabled in the main loop, once the first RTC read has set
+	 * up INT/SQW */
 
+#if CONFIG_CONSOLE
+	console_init();
+#endif
 
+	sei();
+	tm1637_init();
+	rtc_init();
 }
 
 
+/* Call every second. Battery is measured at intervals set by the fuel gauge */
 static bool check_lowbattery(void)
 {
-	static uint8_t adc_count = 0;
-	static uint16_t adc_sum = 0;
-	bool low_bat = false;
-	uint16_t samp;
+	uint8_t load_ma;
+#if BOARD_HAS_LDR
 	uint8_t ldr_val;
+#endif
 
-	ADC_ENABLE();
-	adc_select_channel(BAT_ADC_CHANNEL);
-	_delay_ms(1); /* Start-up time for Internal bandgap reference voltage */
-	samp = adc_samp();
-	adc_sum += samp;
-	if(++adc_count == 4) {
-		adc_sum >>= 2;
-		if(adc_sum < 600) { /* VBAT < 3.0V */
-			low_bat = true;
-		}
-		if(adc_sum > 680) { /* VBAT > 3.4V */
-			low_bat = false;
-		}
-		adc_sum = 0;
-		adc_count = 0;
+	load_ma = (dark ? 0 : pgm_read_byte(&bright_ma[bright_level()])) + (buzzer_on ? BUZZER_MA : 0);
+	if(fg_tick(load_ma)) {
+#if CONFIG_ENERGY
+		energy_event(EN_ADC, 1);
+#endif
 	}
 
-#if 0  // LDR not tested yet
+#if BOARD_HAS_LDR
 	/* Sample LDR value and adjust LED brightness */
+	ADC_ENABLE();
 	adc_select_channel(LDR_ADC_CHANNEL);
 	ADC_LEFT_ADJUST();
 	ldr_val = adc_samp_8();
@@ -570,39 +933,48 @@ static bool check_lowbattery(void)
 	}
 #endif
 
-	return low_bat;
+	return fg_low();
 }
 
 
 
 void display(dispState_t state)
 {
+	static dispState_t last_state;
 	uint8_t digit_buf[4] = {0};
 	uint8_t dot_pos = 0;
+	uint8_t roll = 0;
 	uint8_t hour = g_time.hour;
+	uint16_t remain;
+	int16_t temp;
+#if CONFIG_ENERGY
+	uint8_t unit;
+#endif
+	timer_t tim;
+#if CONFIG_STOPWATCH
+	uint32_t ticks;
+	uint16_t secs, mins;
+#endif
 
-#if !CONFIG_24HR_FORMAT
-	hour = bcd2bin8(hour);  // Time read from RTC is 24hr format, so convert to 12hr format
-	if(hour > 12) {
-		hour -= 12;
-	}
-	else if(!hour) {
-		hour = 12;
+	if(!fmt24) {
+		hour = bcd2bin8(hour);  // Time read from RTC is 24hr format, so convert to 12hr format
+		if(hour > 12) {
+			hour -= 12;
+		}
+		else if(!hour) {
+			hour = 12;
+		}
+		hour = bin2bcd8(hour);
 	}
-	hour = bin2bcd8(hour);
-#endif
 
 	switch(state) {
 	case DISP_HHMM:
 	case DISP_ALARM:
 		tm1637_bcd_to_2digits(hour, &digit_buf[0], false);
 		tm1637_bcd_to_2digits(g_time.min, &digit_buf[2], true);
-		dot_pos = (g_time.sec & 0x1) ? 2 : 0;
-		if((DISP_ALARM == state) && !(g_time.sec & 0x1)) {
-			dot_pos = 3;
-			do {
-				digit_buf[dot_pos] = 0;
-			} while(dot_pos--);
+		dot_pos = (eco || (g_time.sec & 0x1)) ? 2 : 0;  /* Steady in economy: no display write each second */
+		if(state == last_state) {  /* Roll on minute change only, not when coming from other states */
+			roll = 0x0F;
 		}
 		break;
 
@@ -623,204 +995,362 @@ void display(dispState_t state)
 		tm1637_bcd_to_2digits(g_time.month, &digit_buf[2], false);
 		break;
 
+	case DISP_TEMP:
+		temp = (rtc_temp + 2) >> 2;  /* Whole degrees, rounded */
+		if(!temp_valid) {
+			digit_buf[0] = 0x40; // '-'
+			digit_buf[1] = 0x40;
+		}
+		else if(temp < -9) {  /* No room for the sign */
+			digit_buf[0] = 0x38; // 'L'
+			digit_buf[1] = 0x5C; // 'o'
+		}
+		else if(temp > 99) {
+			digit_buf[0] = 0x76; // 'H'
+			digit_buf[1] = 0x10; // 'i'
+		}
+		else if(temp < 0) {
+			tm1637_bcd_to_2digits(bin2bcd8(-temp), &digit_buf[0], false);
+			digit_buf[0] = 0x40; // '-'
+		}
+		else {
+			tm1637_bcd_to_2digits(bin2bcd8(temp), &digit_buf[0], false);
+		}
+		digit_buf[2] = 0x63; // degree
+		digit_buf[3] = 0x39; // 'C'
+		break;
+
+	case DISP_BAT:
+		digit_buf[0] = 0x7C; // 'b'
+		if(fg_valid()) {
+			remain = fg_percent();
+			digit_buf[1] = (remain >= 100) ? 0x06 : 0; // '1'
+			tm1637_bcd_to_2digits(bin2bcd8(remain % 100), &digit_buf[2], remain >= 100);
+		}
+		else {
+			digit_buf[2] = 0x40; // '-'
+			digit_buf[3] = 0x40;
+		}
+		break;
+
+#if CONFIG_ENERGY
+	case DISP_ENERGY:  /* mAh consumed since reset */
+		remain = energy_mah();
+		if(remain > 9999) {
+			remain = 9999;
+		}
+		tm1637_bcd_to_2digits(bin2bcd8(remain / 100), &digit_buf[0], false);
+		tm1637_bcd_to_2digits(bin2bcd8(remain % 100), &digit_buf[2], remain >= 100);
+		if(remain < 100) {
+			digit_buf[1] = 0;
+		}
+		break;
+
+	case DISP_RUNTIME:  /* Projected runtime, hours or days */
+		remain = fg_valid() ? energy_runtime_h((uint16_t)((uint32_t)fg_percent() * BAT_CAPACITY_MAH / 100)) : EN_RUNTIME_UNKNOWN;
+		unit = 0x74; // 'h'
+		if(EN_RUNTIME_UNKNOWN == remain) {
+			digit_buf[1] = 0x40; // '-'
+			digit_buf[2] = 0x40;
+		}
+		else {
+			if(remain > 999) {
+				remain /= 24;
+				unit = 0x5E; // 'd'
+			}
+			if(remain > 999) {
+				remain = 999;
+			}
+			tm1637_bcd_to_2digits(bin2bcd8(remain / 10), &digit_buf[0], false);
+			if(remain < 10) {
+				digit_buf[1] = 0;
+			}
+			tm1637_bcd_to_2digits(bin2bcd8(remain % 10), &digit_buf[2], true);
+			digit_buf[2] = digit_buf[3];  /* Units digit */
+		}
+		digit_buf[3] = unit;
+		break;
+#endif
+
 	case DISP_TIMER_INIT:
+		seconds_to_timer(upt_elapsed(), &tim);
 		digit_buf[0] = 0x78; //'t'
 		digit_buf[1] = 0x10; //'i'
-		tm1637_bcd_to_2digits(bin2bcd8(inc_timer.sec), &digit_buf[2], true);
+		tm1637_bcd_to_2digits(bin2bcd8(tim.sec), &digit_buf[2], true);
 		dot_pos = 2;
 		break;
 
 	case DISP_TIMER_MMSS:
-		tm1637_bcd_to_2digits(bin2bcd8(inc_timer.min), &digit_buf[0], true);
-		tm1637_bcd_to_2digits(bin2bcd8(inc_timer.sec), &digit_buf[2], true);
+		seconds_to_timer(upt_elapsed(), &tim);
+		tm1637_bcd_to_2digits(bin2bcd8(tim.min), &digit_buf[0], true);
+		tm1637_bcd_to_2digits(bin2bcd8(tim.sec), &digit_buf[2], true);
 		dot_pos = 2;
 		break;
 
 	case DISP_CDT_INIT:
 		digit_buf[0] = 0x39; // 'C'
 		digit_buf[1] = 0x5E; // 'd'
-		tm1637_bcd_to_2digits(bin2bcd8(cd_timer.sec), &digit_buf[2], true);
-		dot_pos = 2;
+		tm1637_bcd_to_2digits(bin2bcd8(cdt_count()), &digit_buf[2], false);  /* Timers in use */
 		break;
 
 	case DISP_CDT_MMSS:
-		tm1637_bcd_to_2digits(bin2bcd8(cd_timer.min), &digit_buf[0], true);
-		tm1637_bcd_to_2digits(bin2bcd8(cd_timer.sec), &digit_buf[2], true);
+		seconds_to_timer((cdt_sel != CDT_NONE) ? cdt_remaining(cdt_sel) : 0, &tim);
+		if(tim.hour) {  /* HH:MM from an hour up, as the stopwatch */
+			tim.sec = tim.min;
+			tim.min = tim.hour;
+		}
+		tm1637_bcd_to_2digits(bin2bcd8(tim.min), &digit_buf[0], true);
+		tm1637_bcd_to_2digits(bin2bcd8(tim.sec), &digit_buf[2], true);
 		dot_pos = 2;
 		break;
 
+#if CONFIG_STOPWATCH
+	case DISP_SW_INIT:
+		digit_buf[0] = 0x6D; // 'S'
+		digit_buf[1] = 0x78; // 't'
+		tm1637_bcd_to_2digits(bin2bcd8((uint16_t)(sw_read() >> 15) % 60), &digit_buf[2], true);
+		dot_pos = 2;
+		break;
+
+	case DISP_SW:
+	case DISP_SW_LAP:
+		ticks = (DISP_SW == state) ? sw_read() : sw_lap;
+		secs = (uint16_t)(ticks >> 15);
+		if(secs < 60) {  /* SS.hh */
+			tm1637_bcd_to_2digits(bin2bcd8(secs), &digit_buf[0], false);
+			tm1637_bcd_to_2digits(bin2bcd8(((uint16_t)((ticks >> 7) & 0xFF) * 100) >> 8), &digit_buf[2], true);
+			if(DISP_SW == state) {
+				sw_set_refresh(SW_REFRESH_FAST);
+			}
+		}
+		else {
+			mins = secs / 60;
+			if(mins < 100) {  /* MM:SS */
+				secs %= 60;
+			}
+			else {  /* HH:MM */
+				secs = mins % 60;
+				mins /= 60;
+			}
+			tm1637_bcd_to_2digits(bin2bcd8(mins), &digit_buf[0], true);
+			tm1637_bcd_to_2digits(bin2bcd8(secs), &digit_buf[2], true);
+			if(DISP_SW == state) {
+				sw_set_refresh(SW_REFRESH_SLOW);
+			}
+		}
+		dot_pos = 2;
+		break;
+#endif
+
 	case DISP_DOW:
 	case DISP_EDIT:
 		break;
 	}
 
+	last_state = state;
+	disp_blink((DISP_ALARM == state) ? 0x0F : 0, BLINK_ALARM_TICKS);
 	if((DISP_DOW == state) && g_time.day) {
-		tm1637_send_digits(dow_arr[g_time.day-1], 4, dot_pos);
+		anim_run(disp_set(dow_arr[g_time.day-1], dot_pos, roll));
 	}
 	else {
-		tm1637_send_digits(digit_buf, sizeof(digit_buf), dot_pos);
+		anim_run(disp_set(digit_buf, dot_pos, roll));
 	}
 }
 
 
 
-static void edit(editState_t state)
+#if BOARD_HAS_BUTTON
+/* Show two BCD values on left and right pairs of digits */
+static void show_field(uint8_t left, uint8_t right, uint8_t flags)
 {
-	uint8_t digit_buf[4] = {0};
-	uint8_t dot_pos = 0;
+	uint8_t digit_buf[4];
+	bool zero = (flags & SHOW_ZERO) ? true : false;
 
-	switch(state) {
-	case EDIT_ALARM_INIT:
-		digit_buf[0] = 0x77; // 'A'
-		digit_buf[1] = 0x38; // 'L'
-		digit_buf[2] = 0x5C; // 'o'
-		digit_buf[3] = (alarm_on) ? 0x54 : 0x71; // 'n'/'f'
-		dot_pos = 2;
-		break;
+	tm1637_bcd_to_2digits(left, &digit_buf[0], zero);
+	tm1637_bcd_to_2digits(right, &digit_buf[2], zero);
+	disp_blink(((flags & SHOW_BLINK_L) ? 0x03 : 0) | ((flags & SHOW_BLINK_R) ? 0x0C : 0), BLINK_EDIT_TICKS);
+	anim_run(disp_set(digit_buf, (flags & SHOW_COLON) ? 2 : 0, 0));
+}
+#endif
 
-	case EDIT_ALARM_MIN:
-		tm1637_bcd_to_2digits(g_alarm.hour, &digit_buf[0], true);
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(g_alarm.min, &digit_buf[2], true);
-		}
-		dot_pos = 2;
-		break;
 
-	case EDIT_ALARM_HOUR:
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(g_alarm.hour, &digit_buf[0], true);
-		}
-		tm1637_bcd_to_2digits(g_alarm.min, &digit_buf[2], true);
-		dot_pos = 2;
-		break;
-
-	case EDIT_ALARM_SET:
-	case EDIT_TIME_SET:
-		digit_buf[0] = 0x6D; // 'S'
-		digit_buf[1] = 0x79; // 'E'
-		digit_buf[2] = 0x78; // 't'
-		break;
+/* Show 4 segment patterns */
+static void show_text(uint8_t c0, uint8_t c1, uint8_t c2, uint8_t c3, uint8_t dot_pos)
+{
+	uint8_t digit_buf[4];
+
+	digit_buf[0] = c0;
+	digit_buf[1] = c1;
+	digit_buf[2] = c2;
+	digit_buf[3] = c3;
+	disp_blink(0, 0);
+	anim_run(disp_set(digit_buf, dot_pos, 0));
+}
 
-	case EDIT_TIME_INIT:
-		digit_buf[0] = 0x79; // 'E'
-		digit_buf[1] = 0x5E; // 'd'
-		digit_buf[2] = 0x10; // 'i'
-		digit_buf[3] = 0x78; // 't'
-		break;
 
-	case EDIT_TIME_MIN:
-		tm1637_bcd_to_2digits(e_time.hour, &digit_buf[0], true);
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(e_time.min, &digit_buf[2], true);
-		}
-		dot_pos = 2;
-		break;
+#if BOARD_HAS_BUTTON
+/* Start a UI flow. Returns display state to go to (DISP_EDIT while it runs) */
+static dispState_t flow_start(flow_t fn)
+{
+	flow = fn;
+	PT_INIT(&flow_pt);
+	return flow_run(BTN_NONE);  /* Runs till its first wait */
+}
 
-	case EDIT_TIME_HOUR:
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(e_time.hour, &digit_buf[0], true);
-		}
-		tm1637_bcd_to_2digits(e_time.min, &digit_buf[2], true);
-		dot_pos = 2;
-		break;
 
-	case EDIT_TIME_DATE:
-		tm1637_bcd_to_2digits(e_time.month, &digit_buf[0], false);
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(e_time.date, &digit_buf[2], false);
-		}
-		break;
+/* Pass a button event or EV_TICK to the running UI flow */
+static dispState_t flow_run(uint8_t ev)
+{
+	flow_ev = ev;
+	if(PT_WAITING == flow()) {
+		return DISP_EDIT;
+	}
+	return flow_next;
+}
 
-	case EDIT_TIME_MONTH:
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(e_time.month, &digit_buf[0], false);
-		}
-		tm1637_bcd_to_2digits(e_time.date, &digit_buf[2], false);
-		break;
 
-	case EDIT_TIME_YEAR:
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(0x20, &digit_buf[0], true);
-			tm1637_bcd_to_2digits(e_time.year, &digit_buf[2], true);
+/* Alarm on/off and set up */
+static char flow_alarm(void)
+{
+	PT_BEGIN(&flow_pt);
+
+	flow_btn = 0;
+	while(1) {
+		show_text(0x77, 0x38, 0x5C, (alarm_on) ? 0x54 : 0x71, 2);  // 'AL:on'/'AL:of'
+		FLOW_WAIT_BUTTON();
+		if(!long_press) {
+			break;
 		}
-		break;
-
-	case EDIT_CDT_SEC:
-		tm1637_bcd_to_2digits(bin2bcd8(cd_timer.min), &digit_buf[0], true);
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(bin2bcd8(cd_timer.sec), &digit_buf[2], true);
+		if(!alarm_on) {
+			flow_next = DISP_HHMM;
+			PT_EXIT(&flow_pt);
 		}
-		break;
-
-	case EDIT_CDT_MIN:
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(bin2bcd8(cd_timer.min), &digit_buf[0], true);
+		if(!rtc_alarm2_onoff(ALARM_OFF)) {
+			alarm_on = false;
+			save_settings();
 		}
-		tm1637_bcd_to_2digits(bin2bcd8(cd_timer.sec), &digit_buf[2], true);
-		break;
+	}
 
-	case EDIT_CDT_HOUR:
-		if(g_time.sec & 0x1) {
-			tm1637_bcd_to_2digits(bin2bcd8(cd_timer.hour), &digit_buf[0], true);
-		}
-		tm1637_bcd_to_2digits(bin2bcd8(cd_timer.min), &digit_buf[2], true);
-		break;
+	alarm_on = false; // Prevent alarm going off during set up
+	flow_btn = BTN_MODE_MULTI|BTN_MODE_REPEAT;
+	FLOW_FIELD(show_field(g_alarm.hour, g_alarm.min, SHOW_ZERO|SHOW_COLON|SHOW_BLINK_R),
+			g_alarm.min = increment_minute(g_alarm.min));
+	FLOW_FIELD(show_field(g_alarm.hour, g_alarm.min, SHOW_ZERO|SHOW_COLON|SHOW_BLINK_L),
+			g_alarm.hour = increment_hour(g_alarm.hour));
+
+	g_alarm.day_date = g_time.date; // Day/Date is irrelevant for DAILY alarm type */
+	rtc_set_alarm2(&g_alarm, ALARM_DAILY);
+	if(!rtc_alarm2_onoff(ALARM_ON)) {
+		alarm_on = true;
 	}
-	tm1637_send_digits(digit_buf, sizeof(digit_buf), dot_pos);
+	save_settings();
 
-}
+	flow_btn = 0;
+	show_text(0x6D, 0x79, 0x78, 0, 0);  // 'SEt'
+	FLOW_WAIT_BUTTON();
+	flow_next = DISP_HHMM;
 
+	PT_END(&flow_pt);
+}
 
 
-static void increment_timer(timer_t *tim)
+/* Time and date set up */
+static char flow_time(void)
 {
-	if(++tim->sec > 59) {
-		tim->sec = 0;
-		if(++tim->min > 59) {
-			tim->min = 0;
-			if(++tim->hour > 99) {
-				tim->hour = 0;
-			}
-		}
+	PT_BEGIN(&flow_pt);
+
+	flow_btn = 0;
+	show_text(0x79, 0x5E, 0x10, 0x78, 0);  // 'Edit'
+	FLOW_WAIT_BUTTON();
+	if(long_press) {
+		flow_next = DISP_HHMM;
+		PT_EXIT(&flow_pt);
+	}
+
+	fl.time = g_time;
+	flow_btn = BTN_MODE_MULTI|BTN_MODE_REPEAT;
+	FLOW_FIELD(show_field(fl.time.hour, fl.time.min, SHOW_ZERO|SHOW_COLON|SHOW_BLINK_R),
+			fl.time.min = increment_minute(fl.time.min));
+	FLOW_FIELD(show_field(fl.time.hour, fl.time.min, SHOW_ZERO|SHOW_COLON|SHOW_BLINK_L),
+			fl.time.hour = increment_hour(fl.time.hour));
+	FLOW_FIELD(show_field(fl.time.month, fl.time.date, SHOW_BLINK_R),
+			fl.time.date = increment_date(fl.time.date));
+	FLOW_FIELD(show_field(fl.time.month, fl.time.date, SHOW_BLINK_L),
+			fl.time.month = increment_month(fl.time.month));
+	FLOW_FIELD(show_field(0x20, fl.time.year, SHOW_ZERO|SHOW_BLINK_L|SHOW_BLINK_R),
+			fl.time.year = increment_year(fl.time.year));
+
+	fl.time.sec = 0;
+	fl.time.day = cal_dayofweek(bcd2bin8(fl.time.date), bcd2bin8(fl.time.month), 2000+bcd2bin8(fl.time.year)) + 1;  // Day of week is in the range 1-7
+#if CONFIG_DST
+	cal_dst_standard(&fl.time);  /* RTC keeps standard time */
+#endif
+	if(!rtc_set_time(&fl.time)) {
+		cdt_rebase(cal_seconds(&fl.time));
 	}
+
+	flow_btn = 0;
+	show_text(0x6D, 0x79, 0x78, 0, 0);  // 'SEt'
+	FLOW_WAIT_BUTTON();
+	flow_next = DISP_HHMM;
+
+	PT_END(&flow_pt);
 }
 
 
-static bool decrement_timer(timer_t *tim)
+/* Countdown set up from preset, then start it on cdt_sel (or a new timer) */
+static char flow_cdt(void)
 {
-	if((0 == tim->hour) && (0 == tim->min) && (0 == tim->sec)) {  /* Timer expired */
-		return true;
+	PT_BEGIN(&flow_pt);
+
+	fl.cdt = bkp_timer;
+	flow_btn = BTN_MODE_MULTI|BTN_MODE_REPEAT;
+	FLOW_FIELD(show_field(bin2bcd8(fl.cdt.min), bin2bcd8(fl.cdt.sec), SHOW_ZERO|SHOW_BLINK_R),
+			fl.cdt.sec = (fl.cdt.sec < 59) ? fl.cdt.sec + 1 : 0);
+	FLOW_FIELD(show_field(bin2bcd8(fl.cdt.min), bin2bcd8(fl.cdt.sec), SHOW_ZERO|SHOW_BLINK_L),
+			fl.cdt.min = (fl.cdt.min < 59) ? fl.cdt.min + 1 : 0);
+	FLOW_FIELD(show_field(bin2bcd8(fl.cdt.hour), bin2bcd8(fl.cdt.min), SHOW_ZERO|SHOW_BLINK_L),
+			fl.cdt.hour = (fl.cdt.hour < 99) ? fl.cdt.hour + 1 : 0);
+
+	if(CDT_NONE == cdt_sel) {
+		cdt_sel = cdt_alloc();
 	}
-	if((0 == tim->sec--) && (tim->min)) {
-		tim->sec = 59;
-		if((0 == tim->min--) && (tim->hour)) {
-			tim->min = 59;
-			tim->hour--;
-		}
+	if(cdt_sel != CDT_NONE) {
+		cdt_start(cdt_sel, ((uint32_t)fl.cdt.hour * 60 + fl.cdt.min) * 60 + fl.cdt.sec);
 	}
-	return false;
+	flow_next = DISP_CDT_MMSS;
+
+	PT_END(&flow_pt);
 }
 
+#endif
+
 
-static uint8_t dayofweek(uint8_t date, uint8_t month, uint16_t year)
+/* Split seconds into timer hour (0-99), min and sec */
+static void seconds_to_timer(uint32_t secs, timer_t *tim)
 {
-	uint16_t temp;
+	uint16_t mins = (uint16_t)((secs / 60) % 6000);
 
-	if (month < 3) {
-		year--;
-	}
+	tim->sec = (uint8_t)(secs % 60);
+	tim->min = (uint8_t)(mins % 60);
+	tim->hour = (uint8_t)(mins / 60);
+}
 
-	temp = year + year/4 - year/100 + year/400 + tm[month - 1] + date;
-	return (uint8_t)(temp % 7);
 
+/* Seconds on the RTC (standard) time line of the time shown */
+static uint32_t rtc_seconds(void)
+{
+	return cal_seconds(&g_time) - (dst ? 3600 : 0);
 }
 
 
 
+#if BOARD_HAS_BUTTON
 static __inline__ uint8_t increment_bcd(uint8_t bcd)
 {
 	return (9 == (bcd & 0xF)) ? (bcd+7) : (bcd+1);
 }
+#endif
 
 
 /* Converts BCD (less than 100) to binary */
@@ -838,6 +1368,7 @@ static __inline__ uint8_t bin2bcd8(uint8_t bin)
 
 
 
+#if BOARD_HAS_BUTTON
 static __inline__ uint8_t increment_minute(uint8_t minute)
 {
 	uint8_t ret = increment_bcd(minute);
@@ -886,101 +1417,604 @@ static __inline__ uint8_t increment_year(uint8_t year)
 	}
 	return ret;
 }
+#endif
 
 
-/* Start/Stop buzzer tone */
-static void buzzer(bool on)
+/* Restore settings from EEPROM. Only the first boot reads alarm from RTC */
+static void restore_settings(void)
 {
-	if(on) {
-		TCCR1B = (1 << WGM12)|0x2;
+	settings_t set;
+
+	if(settings_load(&set)) {
+		fmt24 = (set.flags & SET_24HR) ? true : false;
+		alarm_on = (set.flags & SET_ALARM_ON) ? true : false;
+		brightness = (set.bright < sizeof(bright_arr)) ? set.bright : 0;
+		g_alarm.hour = set.alarm_hour;
+		g_alarm.min = set.alarm_min;
+		g_alarm.sec = 0;
+		bkp_timer.hour = set.cdt_hour;
+		bkp_timer.min = set.cdt_min;
+		bkp_timer.sec = set.cdt_sec;
+		vbg_cal = set.vbg_mv;
+#if CONFIG_QUIET_HOURS
+		quiet_start = set.quiet_start;
+		quiet_end = set.quiet_end;
+#endif
 	}
 	else {
-		TCCR1B = 0;
+		rtc_read_alarm2(&g_alarm, &alarm_on);
 	}
+	fg_init(vbg_cal);
 }
 
 
+/* Append current settings to EEPROM log (nothing is written if unchanged) */
+static void save_settings(void)
+{
+	settings_t set;
+
+	set.flags = (fmt24 ? SET_24HR : 0) | (alarm_on ? SET_ALARM_ON : 0);
+	set.bright = brightness;
+	set.alarm_hour = g_alarm.hour;
+	set.alarm_min = g_alarm.min;
+	set.cdt_hour = bkp_timer.hour;
+	set.cdt_min = bkp_timer.min;
+	set.cdt_sec = bkp_timer.sec;
+	set.vbg_mv = vbg_cal;
+#if CONFIG_QUIET_HOURS
+	set.quiet_start = quiet_start;
+	set.quiet_end = quiet_end;
+#else
+	set.quiet_start = QUIET_OFF;
+	set.quiet_end = 0;
+#endif
+	settings_save(&set);
+}
+
 
-/* External Interrupt from DS3231 RTC */
-ISR(INT1_vect)
+#if BOARD_HAS_BUTTON
+/* Button engine mode for the current display state */
+static uint8_t button_mode_for(dispState_t disp)
 {
-	GICR &= ~(1 << INT1); /* Disable Level triggered INT1 interrupt */
-	rtc_flag = true;
+	if(DISP_HHMM == disp) {
+		return BTN_MODE_MULTI;
+	}
+	if(DISP_EDIT == disp) {
+		return flow_btn;
+	}
+	return 0;
 }
+#endif
 
 
-/* External Interrupt from Button */
-ISR(INT0_vect)
+#if CONFIG_CONSOLE
+/* Apply settings received on serial console */
+static void console_apply(console_cmd_t *cmd)
+{
+	uint8_t id;
+	uint16_t bg;
+	ds3231_time_t e_time;
+
+	if(cmd->flags & (CMD_TIME|CMD_DATE)) {
+		e_time = g_time;
+		if(cmd->flags & CMD_TIME) {
+			e_time.hour = cmd->time[0];
+			e_time.min = cmd->time[1];
+			e_time.sec = cmd->time[2];
+		}
+		if(cmd->flags & CMD_DATE) {
+			e_time.date = cmd->date[0];
+			e_time.month = cmd->date[1];
+			e_time.year = cmd->date[2];
+		}
+		e_time.day = cal_dayofweek(bcd2bin8(e_time.date), bcd2bin8(e_time.month), 2000+bcd2bin8(e_time.year)) + 1;
+		g_time = e_time;
+#if CONFIG_DST
+		cal_dst_standard(&e_time);  /* RTC keeps standard time */
+#endif
+		if(!rtc_set_time(&e_time)) {
+			cdt_rebase(cal_seconds(&e_time));
+		}
+	}
+
+	if(cmd->flags & CMD_ALARM) {
+		g_alarm.hour = cmd->alarm[0];
+		g_alarm.min = cmd->alarm[1];
+		g_alarm.sec = 0;
+		g_alarm.day_date = g_time.date; // Day/Date is irrelevant for DAILY alarm type */
+		rtc_set_alarm2(&g_alarm, ALARM_DAILY);
+		if(!rtc_alarm2_onoff(ALARM_ON)) {
+			alarm_on = true;
+		}
+	}
+	else if(cmd->flags & CMD_ALARM_OFF) {
+		if(!rtc_alarm2_onoff(ALARM_OFF)) {
+			alarm_on = false;
+		}
+	}
+
+	if(cmd->flags & CMD_TIMER) {
+		id = cdt_alloc();
+		if(id != CDT_NONE) {
+			cdt_start(id, ((uint32_t)bcd2bin8(cmd->timer[0]) * 60 + bcd2bin8(cmd->timer[1])) * 60 + bcd2bin8(cmd->timer[2]));
+		}
+	}
+
+	if(cmd->flags & CMD_BRIGHT) {
+		brightness = cmd->bright;
+		tm1637_set_brightness(pgm_read_byte(&bright_arr[bright_level()]));
+	}
+
+	if(cmd->flags & CMD_FORMAT) {
+		fmt24 = cmd->fmt24;
+	}
+
+	if(cmd->flags & CMD_VBAT) {
+		bg = fg_calibrate(cmd->vbat);
+		if(bg) {
+			vbg_cal = bg;
+		}
+	}
+
+#if CONFIG_QUIET_HOURS
+	if(cmd->flags & CMD_QUIET) {
+		quiet_start = cmd->quiet[0];
+		quiet_end = cmd->quiet[1];
+	}
+
+	if(cmd->flags & CMD_QUIET_OFF) {
+		quiet_start = QUIET_OFF;
+	}
+#endif
+
+	if(cmd->flags & CMD_DUMP) {
+		console_dump(EE_HIST_START, EE_HIST_SIZE);
+		disp_invalidate();  /* TXD shares the TM1637 DIO pin */
+	}
+
+	save_settings();
+
+#if CONFIG_BOOTLOADER
+	if(cmd->flags & CMD_BOOT) {
+		boot_request();
+	}
+#endif
+}
+#endif
+
+
+#if CONFIG_BOOTLOADER
+/* Stop interrupts and peripherals, and enter the bootloader for an update.
+ * It runs the application again (from reset vector) when done or left idle */
+static void boot_request(void)
 {
-	if(MCUCR & (1 << ISC00)) {  /* Rising Edge INT0 from button release */
-		//button_flag = true;  /* Button released */
-		if(button_samp < 100) {
-			button_flag = true;
-			long_press = false;
+	cli();
+	TIMSK = 0;
+	GICR = 0;
+	TCCR0 = 0;
+	TCCR1B = 0;
+	TCCR2 = 0;
+	ADCSRA = 0;
+	TWCR = 0;
+	console_off();
+	BUZZER_PIN_OFF();
+	LED_OFF();
+	((void (*)(void))BOOT_REQUEST_WORD)();
+}
+#endif
+
+
+/* Call with RTC status and seconds since last call. Reads temperature
+ * registers once after each 64 second conversion (or when the cache is
+ * older than that), never while a conversion is running */
+static void update_temp(uint8_t status, uint8_t secs)
+{
+	if(status & RTC_STATUS_BSY) {
+		temp_age = TEMP_MAX_AGE;  /* Read once it is done */
+	}
+	else if(temp_age >= TEMP_MAX_AGE) {
+		if(!rtc_read_temp(&rtc_temp)) {
+			temp_age = 0;
+			temp_valid = true;
+		}
+	}
+	else {
+		temp_age += secs;
+	}
+}
+
+
+/* Display brightness level of the power profile */
+static uint8_t bright_level(void)
+{
+#if CONFIG_POWER_PROFILES
+	if(!eco) {
+		return sizeof(bright_arr) - 1;  /* Full on charger */
+	}
+#endif
+	return brightness;
+}
+
+
+#if CONFIG_POWER_PROFILES
+/* Switch between performance (on charger) and economy (on battery) profiles */
+static void power_profile(bool economy)
+{
+	eco = economy;
+	fg_economy(economy);
+	tm1637_set_brightness(pgm_read_byte(&bright_arr[bright_level()]));
+}
+#endif
+
+
+#if CONFIG_HISTORY
+/* Log battery and RTC temperature when due. Call once a minute */
+static void log_history(uint32_t now)
+{
+	if(fg_valid() && temp_valid && hist_due(now / 60)) {
+		hist_add(now / 60, fg_mv() / 5, (int8_t)(rtc_temp >> 1));  /* 5mV, 0.5 degC units */
+	}
+}
+#endif
+
+
+/* Start buzzer tone pattern (in flash), or stop it if NULL.
+ * Tone is generated by Timer2, the on/off pattern is stepped by Timer0 */
+static void buzzer(const uint8_t *pattern)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		TCCR2 = 0;
+		BUZZER_PIN_OFF();
+		if(pattern) {
+			buzz_pattern = pattern;
+			buzz_seg = pattern;
+			buzz_ticks = 1;  /* Load first segment at next Timer0 tick */
+			TCCR0 = T0_PRESCALER;
 		}
 		else {
-			no_sleep = false;
+			buzz_seg = NULL;  /* Timer0 stops itself when button is not being sampled */
 		}
-		TCCR0 = 0;
-		MCUCR &= ~((1 << ISC01)|(1 << ISC00)); /* Back to Low Level INT0 (required for Power down mode) */
-		//no_sleep = false;
 	}
-	else {  /* Low Level INT0 from Button press */
-		//GICR &= ~(1 << INT0);  /* Disable level triggered INT0 interrupt */
-		MCUCR |= (1 << ISC01)|(1 << ISC00);  /* Enable Rising Edge INT0 Interrupt */
-		no_sleep = true; /* Prevent sleep while button is depressed to be able to detect button release */
+}
+
 
-		/* Start sampling button press */
-		button_samp = 0;
+/* Schedule next display animation step after ticks of Timer0 (0 for none).
+ * A step already scheduled is kept, so redrawing does not restart a blink */
+static void anim_run(uint8_t ticks)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(ticks && !anim_ticks && !anim_due) {
+			anim_ticks = ticks;
+			t0_run();
+		}
+	}
+}
+
+
+/* Timer0 at the normal rate for a tick count just set, which may be less
+ * than one slow overflow: the ISR slows it down again when all counts
+ * allow. Call with interrupts disabled */
+static void t0_run(void)
+{
+	if(!TCCR0) {
 		TCNT0 = 0;
-		TCCR0 = 4; /* Start Timer0 at 8MHz/256 ~= 31kHz; Overflow occurs at 31kHz/256 = 122Hz (8ms) */
 	}
+	TCCR0 = T0_PRESCALER;
+}
+
+
+
+/* True if an interrupt left work for the main loop. Checked with interrupts
+ * disabled before sleep, so none of the flags is taken here */
+static bool event_pending(void)
+{
+	if(rtc_flag || anim_due) {
+		return true;
+	}
+#if BOARD_HAS_BUTTON
+	if(button_event) {
+		return true;
+	}
+#endif
+#if CONFIG_CONSOLE
+	if(console_line_ready()) {
+		return true;
+	}
+#endif
+#if CONFIG_STOPWATCH
+	if(sw_refresh_due()) {
+		return true;
+	}
+#endif
+	return false;
+}
+
+
+#if CONFIG_QUIET_HOURS
+/* True if hour (BCD) is within quiet hours, which may run past midnight */
+static bool quiet_hours(uint8_t hour)
+{
+	if((QUIET_OFF == quiet_start) || (quiet_start == quiet_end)) {
+		return false;
+	}
+	if(quiet_start < quiet_end) {
+		return (hour >= quiet_start) && (hour < quiet_end);
+	}
+	return (hour >= quiet_start) || (hour < quiet_end);
+}
+
+
+/* Blank the display. TM1637 has no off command in the driver, all digits
+ * are sent empty instead, which draws no segment current */
+static void display_off(void)
+{
+	static const uint8_t blank[DISP_DIGITS];
 
+	disp_blink(0, 0);
+	anim_run(disp_set(blank, 0, 0));
 }
+#endif
 
 
-/* Timer0 Overflow Interrupt for Button sampling */
-ISR(TIMER0_OVF_vect)
+#if TICK_SLEEP
+/* Seconds since midnight of BCD time of day */
+static uint32_t day_seconds(uint8_t hour, uint8_t min, uint8_t sec)
 {
-	if(BUTTON_PRESSED()) {
-		button_samp++;
-		if(button_samp > 100) {
-			button_flag = true;
-			long_press = true;
-			TCCR0 = 0;
-		}
+	return bcd2bin8(hour) * 3600UL + bcd2bin8(min) * 60U + bcd2bin8(sec);
+}
+
+
+/* Seconds from time of day t to the next time of day at, 1 to a whole day */
+static uint32_t day_until(uint32_t t, uint32_t at)
+{
+	return (at > t) ? (at - t) : (at + 86400UL - t);
+}
+
+
+/* The RTC ticks only when the next thing is due instead of every second,
+ * at most secs from now (end of quiet hours, next minute in economy).
+ * That is the alarm, the soonest countdown, a history sample, and the
+ * next hour for DST, or the console listen window on a board without
+ * button. A button press wakes up too. Not while the RTC is in fault
+ * mode, which keeps time on the tick, or the console is on. The low
+ * battery LED is not flashed meanwhile */
+static void tick_sleep(uint32_t secs)
+{
+	ds3231_alarm_t at;
+	uint32_t t, now;
+	uint8_t id;
+
+	if(tick_sleeping || rtc_fault()) {
+		return;
+	}
+#if CONFIG_CONSOLE
+	if(console_enabled()) {
+		return;
+	}
+#endif
+	now = rtc_seconds();
+	t = day_seconds(g_time.hour, g_time.min, g_time.sec);
+	if(alarm_on && (day_until(t, day_seconds(g_alarm.hour, g_alarm.min, g_alarm.sec)) < secs)) {
+		secs = day_until(t, day_seconds(g_alarm.hour, g_alarm.min, g_alarm.sec));
+	}
+	id = cdt_soonest();
+	if((id != CDT_NONE) && !cdt_paused(id) && (cdt_remaining(id) < secs)) {
+		secs = cdt_remaining(id);
+	}
+#if CONFIG_HISTORY
+	if((HIST_INTERVAL_MIN * 60UL - now % (HIST_INTERVAL_MIN * 60UL)) < secs) {
+		secs = HIST_INTERVAL_MIN * 60UL - now % (HIST_INTERVAL_MIN * 60UL);
+	}
+#endif
+#if CONFIG_DST
+	if((3600 - t % 3600) < secs) {
+		secs = 3600 - t % 3600;
+	}
+#endif
+#if CONFIG_CONSOLE && !BOARD_HAS_BUTTON
+	if((60 - t % 60) < secs) {  /* Console is the only way in: its listen window each minute */
+		secs = 60 - t % 60;
+	}
+#endif
+	if(secs < 2) {
+		return;  /* Due on the next tick */
+	}
+
+	t = (now + secs) % 86400UL;  /* RTC time of day */
+	at.hour = bin2bcd8(t / 3600);
+	at.min = bin2bcd8((t / 60) % 60);
+	at.sec = bin2bcd8(t % 60);
+	at.day_date = 0;
+	if(!rtc_wake_at(&at)) {
+		tick_sleeping = true;
+		sleep_since = now;
 	}
+}
+
 
+/* Back on the 1Hz tick after tick_sleep(), on its RTC tick or a button
+ * press. Time is read again and the seconds slept through are counted.
+ * Returns true if it was asleep and is back. If the RTC does not answer,
+ * it stays asleep: tried again on the next tick, from Timer0 once in
+ * fault mode and within its backoff */
+static bool tick_wake(void)
+{
+	uint8_t status;
+	uint32_t now, skip;
+
+	if(!tick_sleeping || rtc_wake_at(NULL)) {
+		return false;
+	}
+	tick_sleeping = false;
+	rtc_read_status(&status);
+	rtc_read_time(&g_time);
+#if CONFIG_DST
+	dst = cal_dst_local(&g_time);
+#endif
+	now = rtc_seconds();
+	cdt_sync(now);
+	if(now > sleep_since + 1) {  /* The ticks not seen */
+		skip = now - sleep_since - 1;
+		power_skip(skip);
+#if CONFIG_ENERGY
+		energy_sleep(skip);
+#endif
+		fg_skip(skip);
+		update_temp(status, (skip < TEMP_MAX_AGE) ? skip : TEMP_MAX_AGE);
+	}
+	return true;
 }
+#endif
 
 
+/* External Interrupt from DS3231 RTC: Alarm 1, every second. The main
+ * loop enables it again once the tick has cleared the alarm flag
+ * Budget: ISR_BUDGET_INT1 cycles */
+ISR(INT1_vect)
+{
+	GICR &= ~(1 << INT1); /* Disable Level triggered INT1 interrupt */
+	rtc_flag = true;
+}
 
 
-/* Timer1 Compare A Match Interrupt for Buzzer output signal generation */
-ISR(TIMER1_COMPA_vect)
+#if BOARD_HAS_BUTTON
+/* External Interrupt from Button (Low Level, required for Power down mode)
+ * Only wakes up and hands over to the button engine on Timer0 tick, which
+ * re-enables INT0 once the button is released and no click is pending.
+ * Budget: ISR_BUDGET_INT0 cycles */
+ISR(INT0_vect)
 {
-	static bool space = false;
-	static uint8_t pulse = 0;
-	static uint16_t int_count = 0;
+	GICR &= ~(1 << INT0);
+	btn_sampling = true; /* Timer0 does not run in Power down */
+	if(TCCR0 != T0_PRESCALER) {  /* May already be running for the buzzer */
+		TCNT0 = 0;
+		TCCR0 = T0_PRESCALER;
+	}
+}
+#endif
+
 
-	if(!space) {
-		if(!(pulse & 0x1)) {
-			PORTC ^= (1 << PC3);
+/* Timer0 Overflow Interrupt for Button engine, buzzer pattern, display animation and
+ * the RTC tick in fault mode (8ms tick)
+ * Button gives click (1-3 clicks in BTN_MODE_MULTI) on release, long press
+ * while held, or accelerating repeats while held in BTN_MODE_REPEAT.
+ * Budget: ISR_BUDGET_TIMER0_OVF cycles */
+ISR(TIMER0_OVF_vect)
+{
+#if BOARD_HAS_BUTTON
+	static bool btn_down, btn_held;
+	static uint8_t btn_timer, btn_interval, btn_clicks;
+#endif
+	const uint8_t *seg;
+	uint8_t s, t, step;
+
+#if BOARD_HAS_BUTTON
+	if(btn_sampling) {
+		if(BUTTON_PRESSED()) {
+			if(!btn_down) {  /* Pressed */
+				btn_down = true;
+				btn_held = false;
+				btn_interval = BTN_REPEAT_START;
+				btn_timer = (button_mode & BTN_MODE_REPEAT) ? BTN_REPEAT_DELAY : BTN_LONG_TICKS;
+			}
+			else if(btn_timer && !--btn_timer) {
+				btn_held = true;
+				btn_clicks = 0;
+				if(button_mode & BTN_MODE_REPEAT) {
+					button_event = BTN_REPEAT;
+					btn_timer = btn_interval;
+					btn_interval -= btn_interval >> 2;
+					if(btn_interval < BTN_REPEAT_MIN) {
+						btn_interval = BTN_REPEAT_MIN;
+					}
+				}
+				else {
+					button_event = BTN_LONG;
+				}
+			}
+		}
+		else if(btn_down) {  /* Released */
+			btn_down = false;
+			if(!btn_held) {
+				btn_clicks++;
+				btn_timer = ((button_mode & BTN_MODE_MULTI) && (btn_clicks < 3)) ? BTN_GAP_TICKS : 1;
+			}
 		}
-		if(++int_count == 500) {  /* 75 ms */
-			int_count = 0;
-			if(++pulse == 7) {
-				pulse = 0;
-				space = true;
+		else if(!btn_timer || !--btn_timer) {  /* Idle or click gap over */
+			if(btn_clicks) {
+				button_event = btn_clicks;  /* BTN_CLICK1..3 */
+				btn_clicks = 0;
+			}
+			else {
+				btn_sampling = false;
+				GICR |= (1 << INT0);
 			}
 		}
 	}
-	else {
-		if(++int_count == 4700) {  /* 750 ms */
-			space = false;
-			int_count = 0;
+#endif
+
+	seg = buzz_seg;
+	if(seg) {
+		if(!--buzz_ticks) {
+			s = pgm_read_byte(seg);
+			if(BUZZ_END == s) {
+				seg = buzz_pattern;
+				s = pgm_read_byte(seg);
+			}
+			buzz_seg = seg + 1;
+			buzz_ticks = s & 0x7F;
+			if(s & 0x80) {
+				TCNT2 = 0;
+				TCCR2 = (1 << WGM21)|T2_PRESCALER;
+			}
+			else {
+				TCCR2 = 0;
+				BUZZER_PIN_OFF();
+			}
+		}
+	}
+
+	step = (T0_SLOW_PRESCALER == TCCR0) ? T0_SLOW_TICKS : 1;
+	s = anim_ticks;
+	if(s) {
+		s -= step;
+		anim_ticks = s;
+		if(!s) {
+			anim_due = true;
 		}
 	}
+	t = tick_ticks;
+	if(t) {
+		t -= step;
+		if(!t) {  /* RTC tick in fault mode, and the next */
+			rtc_flag = true;
+			t = T0_RTC_TICKS;
+		}
+		tick_ticks = t;
+	}
+	if(!seg && !btn_sampling) {  /* Only counts left, if any: slow till the nearest is close */
+		if(t && (!s || (t < s))) {
+			s = t;
+		}
+		TCCR0 = (s > T0_SLOW_TICKS) ? T0_SLOW_PRESCALER : ((s) ? T0_PRESCALER : 0);
+	}
+}
+
+
+/* Timer2 Compare Match Interrupt for Buzzer tone (every 150us while a tone is on)
+ * Toggles the pin with sbi/cbi only: no register or SREG needs saving.
+ * Budget: ISR_BUDGET_TIMER2_COMP cycles */
+ISR(TIMER2_COMP_vect, ISR_NAKED)
+{
+	__asm__ __volatile__ (
+		"sbis %[port], %[bit]"	"\n\t"
+		"rjmp 1f"				"\n\t"
+		"cbi %[port], %[bit]"	"\n\t"
+		"reti"					"\n\t"
+	"1:	sbi %[port], %[bit]"	"\n\t"
+		"reti"					"\n\t"
+		:: [port] "I" (_SFR_IO_ADDR(BUZZER_PORT)), [bit] "I" (BUZZER)
+	);
 }
 
 
@@ -0,0 +1,171 @@
+/*
+ * power.c
+ *
+ *	Sleep mode governor: deepest sleep mode the running peripherals allow
+ *
+ *	The mode is worked out from the peripherals themselves each time, so
+ *	there is no state to keep in step with the rest of the firmware:
+ *
+ *	- Timer0 (button sampling, buzzer pattern, display animation), Timer2
+ *	  (buzzer tone), Timer1 on the stopwatch and the console USART stop
+ *	  with the I/O clock, so any of them running allows only Idle mode.
+ *	  An alarm tone or a held button sleeps between Timer0 ticks.
+ *	- An ADC conversion with none of them running sleeps in ADC Noise
+ *	  Reduction, in Idle mode otherwise.
+ *	- Power down with nothing running, till the RTC tick or a button press.
+ *
+ *	Time in each mode is added up every second (power_tick()). Timer1
+ *	counts time awake, since it stops with the CPU clock in Power down,
+ *	and Idle sleeps are timed on it. Time in ADC Noise Reduction (Timer1
+ *	stopped too) is counted in conversions, and the rest of the second is
+ *	Power down. While the stopwatch has Timer1 the MCU sleeps only in Idle
+ *	mode, so those seconds are counted as Idle, and Timer1 is taken back
+ *	once the stopwatch stops.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "adc.h"
+#include "stopwatch.h"
+#include "power.h"
+
+
+#if F_CPU >= 4000000UL
+#define PWR_T1_PRESCALER	((1 << CS12)|(1 << CS10))
+#else
+#define PWR_T1_PRESCALER	((1 << CS11)|(1 << CS10))
+#endif
+
+static power_stats_t	ps;
+static uint16_t			last[PWR_MODES + 1];	/* Over the last second */
+static uint16_t			last_t1;
+static uint16_t			idle_t1;
+static uint8_t			adc_nr_convs;
+
+
+/* Start Timer1 as awake time counter */
+void power_init(void)
+{
+	TCNT1 = 0;
+	TCCR1B = PWR_T1_PRESCALER;
+	last_t1 = 0;
+	idle_t1 = 0;
+}
+
+
+/* Call every second: adds up time in each mode over the second */
+void power_tick(void)
+{
+	uint16_t t1, awake, idle, adc_nr;
+	uint8_t i;
+
+#if CONFIG_STOPWATCH
+	if(sw_running() || (TCCR1B != PWR_T1_PRESCALER)) {
+		/* Timer1 counts the stopwatch, or did till it stopped this second */
+		if(!sw_running()) {
+			power_init();
+		}
+		awake = idle = PWR_T1_PER_S;
+		idle_t1 = 0;
+	}
+	else
+#endif
+	{
+		t1 = TCNT1;
+		awake = t1 - last_t1;
+		last_t1 = t1;
+		idle = idle_t1;
+		idle_t1 = 0;
+		if(idle > awake) {
+			idle = awake;
+		}
+	}
+
+	adc_nr = (uint16_t)(((uint32_t)adc_nr_convs * PWR_ADC_CONV_US) / PWR_T1_US);
+	adc_nr_convs = 0;
+
+	last[PWR_RUN] = awake - idle;
+	last[PWR_IDLE] = idle;
+	last[PWR_ADC] = adc_nr;
+	last[PWR_DOWN] = (awake + adc_nr < PWR_T1_PER_S) ? (PWR_T1_PER_S - awake - adc_nr) : 0;
+	for(i = 0; i <= PWR_RUN; i++) {
+		ps.time[i] += last[i];
+	}
+}
+
+
+/* Seconds slept through in Power down without power_tick() (RTC tick off
+ * in quiet hours) */
+void power_skip(uint32_t secs)
+{
+	ps.time[PWR_DOWN] += secs * PWR_T1_PER_S;
+}
+
+
+/* Time in mode (or PWR_RUN) over the last second, in PWR_T1_US */
+uint16_t power_last(uint8_t mode)
+{
+	return last[mode];
+}
+
+
+/* Deepest mode allowed by the peripherals running now: PWR_IDLE or PWR_DOWN */
+uint8_t power_mode(void)
+{
+	if(TCCR0 || TCCR2 || (UCSRB & (1 << RXEN))) {
+		return PWR_IDLE;
+	}
+#if CONFIG_STOPWATCH
+	if(sw_running()) {
+		return PWR_IDLE;
+	}
+#endif
+	return PWR_DOWN;
+}
+
+
+/* Sleep in the deepest mode allowed till an interrupt. Call with interrupts
+ * disabled once no event is left pending, so that one setting its flag
+ * meanwhile is not slept through; returns with them enabled.
+ * Returns the mode slept in */
+uint8_t power_sleep(void)
+{
+	uint8_t mode = power_mode();
+	uint16_t start = TCNT1;
+
+	ps.sleeps[mode]++;
+	set_sleep_mode((PWR_IDLE == mode) ? SLEEP_MODE_IDLE : SLEEP_MODE_PWR_DOWN);
+	sleep_enable();
+	sei();  /* Takes effect after the next instruction: no interrupt before sleep */
+	sleep_cpu();
+	sleep_disable();
+	if(PWR_IDLE == mode) {
+		idle_t1 += TCNT1 - start;
+	}
+	return mode;
+}
+
+
+/* One ADC conversion, asleep in ADC Noise Reduction when allowed (Idle
+ * otherwise). Call with interrupts enabled */
+uint16_t power_adc_samp(void)
+{
+	uint16_t val, start;
+
+	if(PWR_IDLE == power_mode()) {
+		ps.sleeps[PWR_IDLE]++;
+		start = TCNT1;
+		val = adc_samp_sleep(SLEEP_MODE_IDLE);
+		idle_t1 += TCNT1 - start;
+	}
+	else {
+		ps.sleeps[PWR_ADC]++;
+		adc_nr_convs++;
+		val = adc_samp_sleep(SLEEP_MODE_ADC);
+	}
+	return val;
+}
@@ -0,0 +1,53 @@
+/*
+ * power.h
+ *
+ *	Sleep mode governor: deepest sleep mode the running peripherals allow
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+
+/* Sleep modes, lightest first */
+#define PWR_IDLE			0		/* Timers or USART running on the I/O clock */
+#define PWR_ADC				1		/* ADC Noise Reduction, through a conversion */
+#define PWR_DOWN			2		/* Only INT0/INT1 wake up */
+#define PWR_MODES			3
+#define PWR_RUN				3		/* Not asleep: time only */
+
+/* Time is counted in Timer1 steps, about 100us */
+#if F_CPU >= 4000000UL
+#define PWR_T1_DIV			1024UL
+#else
+#define PWR_T1_DIV			64UL
+#endif
+#define PWR_T1_US			(PWR_T1_DIV * 1000000UL / F_CPU)
+#define PWR_T1_PER_S		(F_CPU / PWR_T1_DIV)
+#define PWR_ADC_CONV_US		104		/* One ADC conversion, 13 ADC clocks at 125kHz */
+
+/* Residency since reset (read with debugger/simavr) */
+typedef struct _power_stats_t {
+	uint32_t sleeps[PWR_MODES];		/* Times each mode was entered */
+	uint32_t time[PWR_MODES + 1];	/* Time in each mode and running, in PWR_T1_US */
+} power_stats_t;
+
+
+/************ Function declarations *************/
+
+void power_init(void);
+void power_tick(void);
+void power_skip(uint32_t secs);
+uint16_t power_last(uint8_t mode);
+uint8_t power_mode(void);
+uint8_t power_sleep(void);
+uint16_t power_adc_samp(void);
+
+
+#endif /* POWER_H_ */
@@ -0,0 +1,43 @@
+/*
+ * pt.h
+ *
+ *	Stackless coroutines (protothreads) with switch based local continuations
+ *
+ *	A thread is a function that returns PT_WAITING till it ends, and is
+ *	called again to continue from where it waited. Only the line to resume
+ *	at is kept (2 bytes), locals do not survive a wait, so state that must
+ *	be kept goes in static storage. A switch statement can not enclose a
+ *	wait inside a thread.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef PT_H_
+#define PT_H_
+
+#include <stdint.h>
+
+
+typedef uint16_t pt_t;
+
+#define PT_WAITING		0
+#define PT_EXITED		1
+
+#define PT_INIT(pt)				(*(pt) = 0)
+#define PT_BEGIN(pt)			switch(*(pt)) { case 0:
+#define PT_END(pt)				} PT_INIT(pt); return PT_EXITED
+
+/* Return now, and continue here once cond is true */
+#define PT_WAIT_UNTIL(pt, cond)	do { *(pt) = __LINE__; case __LINE__: if(!(cond)) return PT_WAITING; } while(0)
+
+/* Return now, and continue here on next call */
+#define PT_YIELD(pt)			do { *(pt) = __LINE__; return PT_WAITING; case __LINE__:; } while(0)
+
+/* Return now, and continue here on a later call where cond is true */
+#define PT_YIELD_UNTIL(pt, cond)	do { *(pt) = __LINE__; return PT_WAITING; case __LINE__: if(!(cond)) return PT_WAITING; } while(0)
+
+#define PT_EXIT(pt)				do { PT_INIT(pt); return PT_EXITED; } while(0)
+
+
+#endif /* PT_H_ */
@@ -0,0 +1,659 @@
+/*
+ * rtc.c
+ *
+ *	DS3231 access with bounded time on bus faults
+ *
+ *	Registers are read and written here with the TWI polled: each step
+ *	(START, address, one byte, STOP) waits for TWINT at most RTC_STEP_US,
+ *	so a transaction takes at most RTC_TRY_MAX_US whatever the bus does.
+ *	TWI is turned off after each transaction, which also resets it after
+ *	a step that timed out. The watchdog runs over each try only as a
+ *	backstop, well past RTC_TRY_MAX_US: should a try still stall, the
+ *	state kept in .noinit through the reset starts the clock in fault mode.
+ *
+ *	Before a transaction the bus lines are checked idle. A bus held by
+ *	the DS3231 (SDA low part way into a byte) is cleared by clocking SCL
+ *	as GPIO till SDA is let go, then a STOP. A failed transaction is tried
+ *	again after a delay doubling from 2ms, RTC_RETRIES tries in all.
+ *
+ *	The 1Hz tick is Alarm 1 matching every second on INT/SQW (INTCN set),
+ *	not the square wave: INT1 is level triggered to wake from Power down,
+ *	and the square wave would hold it low for half of each second. INT
+ *	stays low from the match till the alarm flags are cleared, which
+ *	rtc_read_status() does on each tick.
+ *
+ *	Once all tries fail, or the bus cannot be cleared, the clock goes to
+ *	fault mode: the RTC is left alone for a backoff time doubling on each
+ *	failed try, and time is kept here on the tick. With the alarm flag
+ *	left set INT stays low, so the tick then comes from Timer0 instead
+ *	(main.c). Time set meanwhile is written to the RTC once it answers
+ *	again.
+ *
+ *	For long sleeps (quiet hours) Alarm 1 can be set to a time of day
+ *	instead, so that it wakes the MCU only then (rtc_wake_at()).
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+#include <util/twi.h>
+#include <string.h>
+#include "config.h"
+#include "board.h"
+#include "calendar.h"
+#include "energy.h"
+#include "rtc.h"
+
+
+#define RTC_MAGIC			0xA5	/* State in .noinit is valid */
+#define TWI_LINES			((1 << TWI_SDA)|(1 << TWI_SCL))
+
+/* Longest try: bounded steps, and the watchdog backstop well past them
+ * (twice, for the poll loop overhead at 1MHz) */
+#define RTC_TRY_MAX_US		(RTC_STEPS_MAX * RTC_STEP_US + RTC_CLEAR_US)
+#if RTC_TRY_MAX_US * 2 > RTC_WDT_MS * 1000UL
+#error "Watchdog backstop too close to the longest RTC try"
+#endif
+#if RTC_CALL_MAX_US > RTC_TICK_BUDGET_MS * 1000UL
+#error "RTC bus time of one tick over RTC_TICK_BUDGET_MS"
+#endif
+
+#define RTC_POLL_US			10		/* TWINT polled this often */
+#define RTC_SCL_HZ			100000UL
+#if F_CPU > 16 * RTC_SCL_HZ
+#define RTC_TWBR			((F_CPU / RTC_SCL_HZ - 16) / 2)
+#else
+#define RTC_TWBR			0		/* F_CPU/16 at the slow clocks */
+#endif
+
+/* DS3231 */
+#define DS3231_SLA			(0x68 << 1)
+#define REG_TIME			0x00	/* Seconds to year */
+#define REG_ALARM1			0x07	/* Seconds, minutes, hour, day/date */
+#define REG_ALARM2			0x0B	/* Minutes, hour, day/date */
+#define REG_CONTROL			0x0E
+#define REG_STATUS			0x0F
+#define REG_TEMP			0x11	/* MSB, LSB in bits 7:6 */
+#define CTRL_EOSC			0x80	/* Oscillator stopped on battery */
+#define CTRL_CONV			0x20
+#define CTRL_RS				0x18	/* SQW rate, 1Hz when 0 */
+#define CTRL_INTCN			0x04	/* INT instead of SQW */
+#define CTRL_A2IE			0x02
+#define CTRL_A1IE			0x01
+#define STAT_EN32KHZ		0x08
+#define STAT_A2F			0x02
+#define STAT_A1F			0x01
+#define A2_MASK				0x80	/* A2M2-A2M4: register not matched */
+#define A1_MASK				0x80	/* A1Mx: register not matched (all four: every second) */
+
+/* Try a transfer as set up by try_begin(), with the DS3231 set up first
+ * if not done yet. err is left RTC_ERR_FAULT if not tried */
+#define RTC_TRY(call)	\
+	for(n = 0; try_begin(n); n++) { \
+		err = init_done ? 0 : ds_setup(); \
+		if(!err) { \
+			err = (call); \
+		} \
+		if(try_end(err)) { \
+			break; \
+		} \
+	}
+
+
+/* Kept through watchdog and external reset */
+static struct {
+	uint8_t magic;
+	bool busy;				/* Transaction running under watchdog */
+	bool fault;
+	bool time_set;			/* Time set in fault mode, to be written to RTC */
+	uint8_t backoff;		/* Seconds between tries in fault mode */
+	uint8_t wait;			/* Seconds to next try */
+	ds3231_time_t time;		/* Local time */
+	rtc_stats_t stats;
+} rs __attribute__((section(".noinit")));
+
+static bool			init_done;		/* DS3231 set up for the 1Hz alarm on INT */
+
+
+static bool bus_idle(void)
+{
+	return (TWI_LINES == (TWI_PIN & TWI_LINES));
+}
+
+
+/* Clock SCL till the slave lets SDA go (at most 9 clocks end its byte),
+ * then START and STOP to reset its interface. Lines are open drain with
+ * pull-ups: driven low by setting DDR, let go by clearing it */
+static bool bus_clear(void)
+{
+	uint8_t pull_ups = TWI_PORT & TWI_LINES;
+	uint8_t i;
+
+	TWCR = 0;  /* TWI off, pins back to GPIO */
+	TWI_PORT &= ~TWI_LINES;
+	for(i = 0; (i < 9) && !(TWI_PIN & (1 << TWI_SDA)); i++) {
+		TWI_DDR |= (1 << TWI_SCL);
+		_delay_us(5);
+		TWI_DDR &= ~(1 << TWI_SCL);
+		_delay_us(5);
+	}
+	TWI_DDR |= (1 << TWI_SDA);
+	_delay_us(5);
+	TWI_DDR &= ~(1 << TWI_SDA);
+	_delay_us(5);
+	TWI_PORT |= pull_ups;
+
+	return bus_idle();
+}
+
+
+/* One TWI step started with twcr. Returns TWI status, or 0xFF if TWINT
+ * was not set within RTC_STEP_US */
+static uint8_t twi_step(uint8_t twcr)
+{
+	uint8_t n = RTC_STEP_US / RTC_POLL_US;
+
+	TWCR = twcr;
+	while(!(TWCR & (1 << TWINT))) {
+		if(!--n) {
+			rs.stats.timeouts++;
+			return 0xFF;
+		}
+		_delay_us(RTC_POLL_US);
+	}
+	return TW_STATUS;
+}
+
+
+/* START, address with direction, and register address for writing */
+static bool twi_begin(uint8_t reg)
+{
+	TWBR = RTC_TWBR;
+	TWSR = 0;
+	if(TW_START != twi_step((1 << TWINT)|(1 << TWSTA)|(1 << TWEN))) {
+		return false;
+	}
+	TWDR = DS3231_SLA | TW_WRITE;
+	if(TW_MT_SLA_ACK != twi_step((1 << TWINT)|(1 << TWEN))) {
+		return false;
+	}
+	TWDR = reg;
+	return (TW_MT_DATA_ACK == twi_step((1 << TWINT)|(1 << TWEN)));
+}
+
+
+/* STOP, waited for as a step, then TWI off till the next transaction */
+static void twi_end(void)
+{
+	uint8_t n = RTC_STEP_US / RTC_POLL_US;
+
+	TWCR = (1 << TWINT)|(1 << TWSTO)|(1 << TWEN);
+	while((TWCR & (1 << TWSTO)) && --n) {
+		_delay_us(RTC_POLL_US);
+	}
+	TWCR = 0;
+}
+
+
+/* Read len registers from reg on. Returns 0 on success */
+static uint8_t ds_read(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+	uint8_t err = RTC_ERR_BUS;
+
+	if(twi_begin(reg) &&
+			(TW_REP_START == twi_step((1 << TWINT)|(1 << TWSTA)|(1 << TWEN)))) {
+		TWDR = DS3231_SLA | TW_READ;
+		if(TW_MR_SLA_ACK == twi_step((1 << TWINT)|(1 << TWEN))) {
+			for(; len > 1; len--) {
+				if(TW_MR_DATA_ACK != twi_step((1 << TWINT)|(1 << TWEA)|(1 << TWEN))) {
+					break;
+				}
+				*buf++ = TWDR;
+			}
+			if((1 == len) && (TW_MR_DATA_NACK == twi_step((1 << TWINT)|(1 << TWEN)))) {  /* Last byte */
+				*buf = TWDR;
+				err = 0;
+			}
+		}
+	}
+	twi_end();
+	return err;
+}
+
+
+/* Write len registers from reg on. Returns 0 on success */
+static uint8_t ds_write(uint8_t reg, const uint8_t *buf, uint8_t len)
+{
+	uint8_t err = RTC_ERR_BUS;
+
+	if(twi_begin(reg)) {
+		while(len) {
+			TWDR = *buf++;
+			if(TW_MT_DATA_ACK != twi_step((1 << TWINT)|(1 << TWEN))) {
+				break;
+			}
+			len--;
+		}
+		if(!len) {
+			err = 0;
+		}
+	}
+	twi_end();
+	return err;
+}
+
+
+/* Alarm 1 every second on INT/SQW (INT1), oscillator on, 32kHz output for
+ * the stopwatch only, alarm flags cleared. reg holds Alarm 1 to status
+ * (REG_ALARM1 to REG_STATUS) as read, written back only if that changes
+ * them: Alarm 2 as read, OSF kept */
+static uint8_t ds_setup_regs(uint8_t *reg)
+{
+	uint8_t old[REG_STATUS - REG_ALARM1 + 1];
+	uint8_t err = 0;
+
+	memcpy(old, reg, sizeof(old));
+	memset(reg, A1_MASK, 4);
+	reg[REG_CONTROL - REG_ALARM1] &= ~(CTRL_EOSC|CTRL_CONV|CTRL_RS);
+	reg[REG_CONTROL - REG_ALARM1] |= CTRL_INTCN|CTRL_A1IE;
+#if CONFIG_STOPWATCH
+	reg[REG_STATUS - REG_ALARM1] |= STAT_EN32KHZ;
+#else
+	reg[REG_STATUS - REG_ALARM1] &= ~STAT_EN32KHZ;
+#endif
+	reg[REG_STATUS - REG_ALARM1] &= ~(STAT_A1F|STAT_A2F);
+	if(memcmp(old, reg, sizeof(old))) {
+		err = ds_write(REG_ALARM1, reg, sizeof(old));
+	}
+	init_done = !err;
+	return err;
+}
+
+
+static uint8_t ds_setup(void)
+{
+	uint8_t reg[REG_STATUS - REG_ALARM1 + 1];  /* Alarm 1 to status */
+	uint8_t err;
+
+	err = ds_read(REG_ALARM1, reg, sizeof(reg));
+	if(!err) {
+		err = ds_setup_regs(reg);
+	}
+	return err;
+}
+
+
+/* Status, with the alarm flags cleared if set: lets INT go high again */
+static uint8_t ds_ack(uint8_t *status)
+{
+	uint8_t stat;
+	uint8_t err;
+
+	err = ds_read(REG_STATUS, status, 1);
+	if(!err && (*status & (STAT_A1F|STAT_A2F))) {
+		stat = *status & ~(STAT_A1F|STAT_A2F);
+		err = ds_write(REG_STATUS, &stat, 1);
+	}
+	return err;
+}
+
+
+/* Time registers: 24 hour format, century bit dropped */
+static uint8_t ds_read_time(ds3231_time_t *t)
+{
+	uint8_t reg[7];
+	uint8_t err;
+
+	err = ds_read(REG_TIME, reg, sizeof(reg));
+	if(!err) {
+		t->sec = reg[0] & 0x7F;
+		t->min = reg[1] & 0x7F;
+		t->hour = reg[2] & 0x3F;
+		t->day = reg[3] & 0x07;
+		t->date = reg[4] & 0x3F;
+		t->month = reg[5] & 0x1F;
+		t->year = reg[6];
+	}
+	return err;
+}
+
+
+/* Time, control and status in one read, with the DS3231 set up from it */
+static uint8_t ds_read_first(ds3231_time_t *t, uint8_t *status)
+{
+	uint8_t reg[REG_STATUS + 1];
+	uint8_t err;
+
+	err = ds_read(REG_TIME, reg, sizeof(reg));
+	if(!err) {
+		t->sec = reg[0] & 0x7F;
+		t->min = reg[1] & 0x7F;
+		t->hour = reg[2] & 0x3F;
+		t->day = reg[3] & 0x07;
+		t->date = reg[4] & 0x3F;
+		t->month = reg[5] & 0x1F;
+		t->year = reg[6];
+		*status = reg[REG_STATUS];
+		err = ds_setup_regs(&reg[REG_ALARM1]);
+	}
+	return err;
+}
+
+
+/* Set time and clear the oscillator stop flag */
+static uint8_t ds_set_time(const ds3231_time_t *t)
+{
+	uint8_t reg[7] = { t->sec, t->min, t->hour, t->day, t->date, t->month, t->year };
+	uint8_t err;
+
+	err = ds_write(REG_TIME, reg, sizeof(reg));
+	if(!err) {
+		err = ds_read(REG_STATUS, reg, 1);
+	}
+	if(!err && (reg[0] & RTC_STATUS_OSF)) {
+		reg[0] &= ~RTC_STATUS_OSF;
+		err = ds_write(REG_STATUS, reg, 1);
+	}
+	return err;
+}
+
+
+static uint8_t ds_alarm2_onoff(uint8_t on)
+{
+	uint8_t ctrl;
+	uint8_t err;
+
+	err = ds_read(REG_CONTROL, &ctrl, 1);
+	if(!err) {
+		ctrl = (ALARM_ON == on) ? (ctrl | CTRL_A2IE) : (ctrl & ~CTRL_A2IE);
+		err = ds_write(REG_CONTROL, &ctrl, 1);
+	}
+	return err;
+}
+
+
+/* Alarm 1 at the time of day given, or back to every second if NULL.
+ * Both alarm flags are cleared: a flag left set (Alarm 2 matches whether
+ * or not it is used) holds INT low */
+static uint8_t ds_wake_at(const ds3231_alarm_t *at)
+{
+	uint8_t reg[4] = { A1_MASK, A1_MASK, A1_MASK, A1_MASK };
+	uint8_t err;
+
+	if(at) {
+		reg[0] = at->sec;
+		reg[1] = at->min;
+		reg[2] = at->hour;
+	}
+	err = ds_write(REG_ALARM1, reg, 4);
+	if(!err) {
+		err = ds_ack(reg);
+	}
+	return err;
+}
+
+
+/* Leave the RTC alone for a while, longer each time */
+static void fault_enter(void)
+{
+	if(!rs.fault) {
+		rs.fault = true;
+		rs.stats.faults++;
+		rs.backoff = RTC_BACKOFF_MIN_S;
+	}
+	else if(rs.backoff < RTC_BACKOFF_MAX_S) {
+		rs.backoff <<= 1;
+	}
+	rs.wait = rs.backoff;
+}
+
+
+/* Before try n of a transaction. Returns false to give up: waiting out
+ * fault mode backoff, bus stuck, or out of tries (fault mode) */
+static bool try_begin(uint8_t n)
+{
+	uint8_t i;
+
+	if(n >= RTC_RETRIES) {
+		fault_enter();
+		return false;
+	}
+	if(n) {
+		for(i = 0; i < (1 << n); i++) {
+			_delay_ms(1);
+		}
+	}
+	else if(rs.fault && rs.wait) {
+		return false;
+	}
+
+	if(!bus_idle()) {
+		rs.stats.bus_clears++;
+		if(!bus_clear()) {
+			fault_enter();
+			return false;
+		}
+	}
+	rs.busy = true;
+	wdt_enable(WDTO_60MS);  /* Backstop only: steps are bounded */
+	return true;
+}
+
+
+/* After a try with the transfer result. Returns true when done */
+static bool try_end(uint8_t err)
+{
+	wdt_disable();
+	rs.busy = false;
+#if CONFIG_ENERGY
+	energy_event(EN_TWI, 1);
+#endif
+	if(err) {
+		rs.stats.errors++;
+		return false;
+	}
+	rs.fault = false;
+	return true;
+}
+
+
+/* Call once at start up */
+void rtc_init(void)
+{
+	uint8_t reset = MCUCSR;
+
+	MCUCSR = 0;
+	wdt_disable();
+	if((reset & ((1 << PORF)|(1 << BORF))) || (RTC_MAGIC != rs.magic)) {
+		memset(&rs, 0, sizeof(rs));
+		rs.magic = RTC_MAGIC;
+		rs.time.day = 7;  /* 2000-01-01 00:00:00 Saturday, till the RTC is read */
+		rs.time.date = 1;
+		rs.time.month = 1;
+	}
+	else if(rs.busy && (reset & (1 << WDRF))) {  /* Last try stalled past the backstop */
+		rs.stats.resets++;
+		fault_enter();
+	}
+	rs.busy = false;
+	init_done = false;  /* Set up on the first transfer */
+}
+
+
+/* First time and status read after rtc_init(), with the DS3231 set up in
+ * the same transfer to keep boot short. As rtc_read_status() and
+ * rtc_read_time() otherwise */
+uint8_t rtc_read_first(ds3231_time_t *t, uint8_t *status)
+{
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	if(init_done || rs.time_set) {
+		err = rtc_read_status(status);
+		return rtc_read_time(t) | err;
+	}
+	for(n = 0; try_begin(n); n++) {
+		err = ds_read_first(t, status);
+		if(try_end(err)) {
+			break;
+		}
+	}
+	if(err) {
+		*status = 0;
+		*t = rs.time;
+	}
+	else {
+		rs.time = *t;
+	}
+	return err;
+}
+
+
+/* Call every second on the RTC tick, before reading time */
+void rtc_tick(void)
+{
+	cal_tick(&rs.time);
+	rtc_wait_tick();
+}
+
+
+/* Call instead of rtc_tick() on a tick that does not count time (asleep
+ * on the RTC alarm): fault mode backoff only */
+void rtc_wait_tick(void)
+{
+	if(rs.wait) {
+		rs.wait--;
+	}
+}
+
+
+/* True while in fault mode, with time kept locally */
+bool rtc_fault(void)
+{
+	return rs.fault;
+}
+
+
+/* Status register. Clears the alarm flags too, which ends the tick on INT:
+ * call on each tick */
+uint8_t rtc_read_status(uint8_t *status)
+{
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	RTC_TRY(ds_ack(status));
+	if(err) {
+		*status = 0;
+	}
+	return err;
+}
+
+
+/* Time from RTC, or local time in fault mode (returning error) */
+uint8_t rtc_read_time(ds3231_time_t *t)
+{
+	ds3231_time_t now;
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	if(rs.time_set) {  /* RTC back after time was set: takes local time */
+		RTC_TRY(ds_set_time(&rs.time));
+		if(!err) {
+			rs.time_set = false;
+		}
+	}
+	else {
+		RTC_TRY(ds_read_time(&now));
+		if(!err) {
+			rs.time = now;
+		}
+	}
+	*t = rs.time;
+	return err;
+}
+
+
+/* Time counted on the tick since the RTC was last read, without bus access */
+void rtc_local_time(ds3231_time_t *t)
+{
+	*t = rs.time;
+}
+
+
+/* Set time in RTC, or locally to be written later if it does not answer.
+ * Returns 0 either way */
+uint8_t rtc_set_time(const ds3231_time_t *t)
+{
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	rs.time = *t;
+	RTC_TRY(ds_set_time(&rs.time));
+	rs.time_set = (err != 0);
+	return 0;
+}
+
+
+/* Temperature in 1/4 degree C */
+uint8_t rtc_read_temp(int16_t *temp)
+{
+	uint8_t reg[2];
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	RTC_TRY(ds_read(REG_TEMP, reg, sizeof(reg)));
+	if(!err) {
+		*temp = (int16_t)(((uint16_t)reg[0] << 8) | reg[1]) >> 6;
+	}
+	return err;
+}
+
+
+uint8_t rtc_read_alarm2(ds3231_alarm_t *alarm, bool *on)
+{
+	uint8_t reg[4];  /* Alarm 2 minutes, hour, day/date, control */
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	RTC_TRY(ds_read(REG_ALARM2, reg, sizeof(reg)));
+	if(!err) {
+		alarm->sec = 0;
+		alarm->min = reg[0] & 0x7F;
+		alarm->hour = reg[1] & 0x3F;
+		alarm->day_date = reg[2] & 0x3F;
+		*on = (reg[3] & CTRL_A2IE) != 0;
+	}
+	return err;
+}
+
+
+/* Alarm 2 on hour and minute (ALARM_DAILY), or on date too */
+uint8_t rtc_set_alarm2(ds3231_alarm_t *alarm, uint8_t type)
+{
+	uint8_t reg[3];
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	reg[0] = alarm->min;
+	reg[1] = alarm->hour;
+	reg[2] = (ALARM_DAILY == type) ? (A2_MASK | alarm->day_date) : alarm->day_date;
+	RTC_TRY(ds_write(REG_ALARM2, reg, sizeof(reg)));
+	return err;
+}
+
+
+uint8_t rtc_alarm2_onoff(uint8_t on)
+{
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	RTC_TRY(ds_alarm2_onoff(on));
+	return err;
+}
+
+
+/* Tick only once, at the given RTC time of day (sec, min, hour in BCD),
+ * instead of every second; NULL goes back to the 1Hz tick. Time is not
+ * counted here meanwhile: read it again after */
+uint8_t rtc_wake_at(const ds3231_alarm_t *at)
+{
+	uint8_t err = RTC_ERR_FAULT, n;
+
+	RTC_TRY(ds_wake_at(at));
+	return err;
+}
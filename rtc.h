@@ -0,0 +1,70 @@
+/*
+ * rtc.h
+ *
+ *	DS3231 access with bounded time on bus faults, and local timekeeping
+ *	while the RTC does not answer
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef RTC_H_
+#define RTC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ds3231.h"
+
+
+#define RTC_RETRIES			3		/* Tries of a transaction before fault mode */
+#define RTC_BACKOFF_MIN_S	2		/* Fault mode: seconds to next try, doubling */
+#define RTC_BACKOFF_MAX_S	64		/* ...up to this */
+#define RTC_STEP_US			500		/* Longest wait for one TWI step (a byte is 90us at 100kHz, 144us at F_CPU/16) */
+#define RTC_STEPS_MAX		51		/* Steps in the longest try: DS3231 set up (28) with time set (23), wake alarm (20) or status (12), first read (35) */
+#define RTC_CLEAR_US		100		/* Bus clear */
+#define RTC_WDT_MS			69		/* Watchdog backstop on one try (WDTO_60MS at 3V) */
+
+/* Worst case bus time of one call: all tries at their longest plus the
+ * delays between them. This bounds the 1Hz tick too: after one call
+ * fails all tries, the others return at once (fault mode backoff).
+ * Checked against RTC_TICK_BUDGET_MS at build time (rtc.c) */
+#define RTC_CALL_MAX_US		(RTC_RETRIES * (RTC_STEPS_MAX * RTC_STEP_US + RTC_CLEAR_US) + \
+								(((1UL << RTC_RETRIES) - 2) * 1000UL))
+#define RTC_TICK_BUDGET_MS	100		/* RTC bus time allowed in one tick */
+
+#define RTC_ERR_FAULT		0xFF	/* Not tried: fault mode backoff or bus stuck */
+#define RTC_ERR_BUS			0xFE	/* Step timed out, or not acknowledged */
+
+/* Status register */
+#define RTC_STATUS_OSF		0x80	/* Oscillator was stopped: time not valid */
+#define RTC_STATUS_BSY		0x04	/* Temperature conversion running */
+
+/* Fault counters, kept through watchdog and external reset (read with debugger/simavr) */
+typedef struct _rtc_stats_t {
+	uint16_t errors;		/* Failed tries */
+	uint16_t timeouts;		/* TWI steps timed out */
+	uint16_t resets;		/* Tries stalled past the watchdog backstop */
+	uint16_t bus_clears;	/* Bus found held and clocked free */
+	uint16_t faults;		/* Times in fault mode */
+} rtc_stats_t;
+
+
+/************ Function declarations *************/
+
+void rtc_init(void);
+uint8_t rtc_read_first(ds3231_time_t *t, uint8_t *status);
+void rtc_tick(void);
+void rtc_wait_tick(void);
+bool rtc_fault(void);
+uint8_t rtc_read_status(uint8_t *status);
+uint8_t rtc_read_time(ds3231_time_t *t);
+void rtc_local_time(ds3231_time_t *t);
+uint8_t rtc_set_time(const ds3231_time_t *t);
+uint8_t rtc_read_temp(int16_t *temp);
+uint8_t rtc_read_alarm2(ds3231_alarm_t *alarm, bool *on);
+uint8_t rtc_set_alarm2(ds3231_alarm_t *alarm, uint8_t type);
+uint8_t rtc_alarm2_onoff(uint8_t on);
+uint8_t rtc_wake_at(const ds3231_alarm_t *at);
+
+
+#endif /* RTC_H_ */
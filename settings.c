@@ -0,0 +1,47 @@
+/*
+ * settings.c
+ *
+ *	Non volatile settings kept in a wear levelled log in EEPROM
+ *
+ *	Settings are appended to an eelog ring, see eelog.c. Unchanged
+ *	settings are not written again.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <string.h>
+#include "eeprom_map.h"
+#include "eelog.h"
+#include "settings.h"
+
+
+static eelog_t		set_log = EELOG_INIT(EE_SETTINGS_START, EE_SETTINGS_SLOT_SIZE, EE_SETTINGS_SLOTS, SETTINGS_VERSION);
+static settings_t	last;				/* Last saved or loaded settings */
+static bool			last_valid;
+
+/* Record must fit in EEPROM slot (with tag, sequence and CRC) */
+typedef char settings_size_check[(sizeof(settings_t) + 3 <= EE_SETTINGS_SLOT_SIZE) ? 1 : -1];
+
+
+/* Restore newest valid settings. Returns false if none, set is left unchanged */
+bool settings_load(settings_t *set)
+{
+	last_valid = eelog_load(&set_log, &last, sizeof(last));
+	if(last_valid) {
+		*set = last;
+	}
+	return last_valid;
+}
+
+
+/* Append settings to the log if changed since last save */
+void settings_save(const settings_t *set)
+{
+	if(last_valid && (0 == memcmp(set, &last, sizeof(settings_t)))) {
+		return;
+	}
+	eelog_append(&set_log, set, sizeof(settings_t));
+	last = *set;
+	last_valid = true;
+}
@@ -0,0 +1,45 @@
+/*
+ * settings.h
+ *
+ *	Non volatile settings kept in a wear levelled log in EEPROM
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define SETTINGS_VERSION	3
+
+/* settings_t flags */
+#define SET_24HR			0x01
+#define SET_ALARM_ON		0x02
+
+#define QUIET_OFF			0xFF	/* quiet_start with no quiet hours */
+
+typedef struct _settings_t {
+	uint8_t flags;
+	uint8_t bright;			/* Brightness level */
+	uint8_t alarm_hour;		/* BCD */
+	uint8_t alarm_min;		/* BCD */
+	uint8_t cdt_hour;		/* Countdown preset */
+	uint8_t cdt_min;
+	uint8_t cdt_sec;
+	uint16_t vbg_mv;		/* Fuel gauge bandgap calibration, 0 if not done */
+	uint8_t quiet_start;	/* Quiet hours start and end hour (BCD), start QUIET_OFF if none */
+	uint8_t quiet_end;
+} settings_t;
+
+
+/************ Function declarations *************/
+
+bool settings_load(settings_t *set);
+void settings_save(const settings_t *set);
+
+
+#endif /* SETTINGS_H_ */
@@ -0,0 +1,151 @@
+/*
+ * stopwatch.c
+ *
+ *	High resolution stopwatch using DS3231 32.768kHz output as Timer1 clock
+ *
+ *	Timer1 free runs on the external T1 pin, overflowing every 2 seconds.
+ *	Elapsed time is overflow count and TCNT1 combined, so there is no
+ *	interrupt per 1/100 s. Compare B interrupt only paces display refresh.
+ *	While stopped, Timer1 and the T1 pull-up are off and the 1Hz power down
+ *	path of the clock is unchanged. Note that Timer1 needs the CPU clock
+ *	running, so only Idle sleep is possible while the stopwatch runs.
+ *
+ *	Elapsed time is saved on stop and loaded back into Timer1 on start, so
+ *	Timer1 is free for awake time accounting (power.c) while stopped.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "board.h"
+#include "stopwatch.h"
+
+#if CONFIG_STOPWATCH
+
+/* Timer1 clocked from T1 pin, rising edge */
+#define T1_EXT_CLOCK	((1 << CS12)|(1 << CS11)|(1 << CS10))
+
+static volatile uint16_t	sw_ovf;		/* 2 second units */
+static volatile bool		sw_flag;
+static bool					sw_on;
+static uint32_t				sw_saved;	/* Elapsed time while stopped */
+static uint16_t				sw_step = SW_REFRESH_SLOW;
+
+
+/* Schedule next Compare B (refresh) interrupt */
+static void next_refresh(void)
+{
+	OCR1B = (sw_step) ? (TCNT1 + sw_step) : ((TCNT1 & 0x8000) ^ 0x8000);
+}
+
+
+/* Start or resume counting */
+void sw_start(void)
+{
+	SW_CLK_PORT |= (1 << SW_CLK);	/* 32K output is open drain */
+	TCCR1B = 0;
+	TCNT1 = (uint16_t)sw_saved;
+	sw_ovf = (uint16_t)(sw_saved >> 16);
+	next_refresh();
+	TIFR = (1 << OCF1B)|(1 << TOV1);
+	TIMSK |= (1 << OCIE1B)|(1 << TOIE1);
+	TCCR1B = T1_EXT_CLOCK;
+	sw_on = true;
+}
+
+
+/* Pause counting, elapsed time is retained */
+void sw_stop(void)
+{
+	if(!sw_on) {
+		return;  /* Timer1 may be counting for energy.c */
+	}
+	sw_saved = sw_read();
+	sw_on = false;
+	TCCR1B = 0;
+	TIMSK &= ~((1 << OCIE1B)|(1 << TOIE1));
+	SW_CLK_PORT &= ~(1 << SW_CLK);
+}
+
+
+/* Stop and clear elapsed time */
+void sw_reset(void)
+{
+	sw_stop();
+	sw_saved = 0;
+}
+
+
+bool sw_running(void)
+{
+	return sw_on;
+}
+
+
+/* Elapsed time in 1/32768 s ticks */
+uint32_t sw_read(void)
+{
+	uint16_t cnt, ovf;
+
+	if(!sw_on) {
+		return sw_saved;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		cnt = TCNT1;
+		ovf = sw_ovf;
+		if((TIFR & (1 << TOV1)) && (cnt < 0x8000)) {  /* Overflow not yet serviced */
+			ovf++;
+		}
+	}
+	return ((uint32_t)ovf << 16) | cnt;
+}
+
+
+/* Set display refresh interval in ticks. SW_REFRESH_SLOW refreshes on
+ * each stopwatch second boundary */
+void sw_set_refresh(uint16_t interval)
+{
+	if(interval == sw_step) {
+		return;
+	}
+	sw_step = interval;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		next_refresh();
+	}
+}
+
+
+/* Returns true once for each refresh interval elapsed */
+bool sw_refresh_pending(void)
+{
+	bool ret = sw_flag;
+	sw_flag = false;
+	return ret;
+}
+
+
+/* True while a refresh is pending, without taking it (check before sleep) */
+bool sw_refresh_due(void)
+{
+	return sw_flag;
+}
+
+
+/* Budget: ISR_BUDGET_TIMER1_OVF cycles */
+ISR(TIMER1_OVF_vect)
+{
+	sw_ovf++;
+}
+
+
+/* Budget: ISR_BUDGET_TIMER1_COMPB cycles */
+ISR(TIMER1_COMPB_vect)
+{
+	OCR1B += (sw_step) ? sw_step : 0x8000;
+	sw_flag = true;
+}
+
+#endif /* CONFIG_STOPWATCH */
@@ -0,0 +1,39 @@
+/*
+ * stopwatch.h
+ *
+ *	High resolution stopwatch using DS3231 32.768kHz output as Timer1 clock
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Visakhan
+ */
+
+#ifndef STOPWATCH_H_
+#define STOPWATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+
+/* Stopwatch ticks per second (DS3231 32K output) */
+#define SW_TICKS_PER_SEC	32768UL
+
+/* Display refresh interval while showing SS.hh (1/32 s) */
+#define SW_REFRESH_FAST		1024
+/* Display refresh interval while showing MM:SS (1 s) */
+#define SW_REFRESH_SLOW		0
+
+
+/************ Function declarations *************/
+
+void sw_start(void);
+void sw_stop(void);
+void sw_reset(void);
+bool sw_running(void);
+uint32_t sw_read(void);
+void sw_set_refresh(uint16_t interval);
+bool sw_refresh_pending(void);
+bool sw_refresh_due(void);
+
+
+#endif /* STOPWATCH_H_ */
@@ -10,18 +10,19 @@
 #ifndef TM1637_CONFIG_H_
 #define TM1637_CONFIG_H_
 
+#include "board.h"  /* Pins of the board revision */
 
 /* Clock pin of TM1637 */
 #define TM1637_CLK_PORT		PORTD
 #define TM1637_CLK_PIN		PIND
 #define TM1637_CLK_DDR		DDRD
-#define TM1637_CLK_BIT		PD4
+#define TM1637_CLK_BIT		TM1637_CLK
 
 /* DIO pin of TM1637 */
 #define TM1637_DIO_PORT		PORTD
 #define TM1637_DIO_PIN		PIND
 #define TM1637_DIO_DDR		DDRD
-#define TM1637_DIO_BIT		PD1
+#define TM1637_DIO_BIT		TM1637_DIO
 
 
 
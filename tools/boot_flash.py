@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""
+boot_flash.py
+
+Update the Digital Clock firmware through its serial bootloader (boot.c).
+The clock sends a CRC-16 of each flash page and only pages that differ from
+the new image are written, so a small change takes seconds. Give several
+ports to update a rack of clocks one after the other.
+
+By default the bootloader is entered with 'U=boot' on the console, which
+listens for 10 seconds after boot and for 2 seconds each minute: reset or
+power up the clocks while this runs, or let it wait for the next minute. With --enter break the line is held in break for a few seconds
+instead, reset the clock meanwhile. A clock with no application stays in
+the bootloader (after 'make boot-program'), any mode finds it.
+
+  boot_flash.py main.hex /dev/ttyUSB0
+  boot_flash.py main.hex /dev/ttyUSB0 /dev/ttyUSB1 /dev/ttyUSB2
+  boot_flash.py main.hex /dev/ttyUSB0 --check      list pages that differ
+  boot_flash.py main.hex /dev/ttyUSB0 --baud 9600  CLOCK=rc2 or rc1 builds
+
+Protocol is described in boot.h. To test under simavr, run boot.elf with the
+uart pty enabled and pass the pty device (e.g. /tmp/simavr-uart0) as the port.
+"""
+
+import argparse
+import binascii
+import sys
+import time
+
+# boot.h
+CMD_SYNC = b'S'
+CMD_HASH = b'H'
+CMD_WRITE = b'W'
+CMD_GO = b'G'
+ACK = b'K'
+NAK = b'E'
+PAGE_SIZE = 64
+BOOT_VERSION = 1
+
+CONSOLE_BAUD = 9600
+RETRIES = 3
+
+
+def checksum(body):
+    s = 0
+    for c in body.encode('ascii'):
+        s ^= c
+    return '%02X' % s
+
+
+def crc16(data):
+    """CRC-16/XMODEM as _crc_xmodem_update()"""
+    return binascii.crc_hqx(data, 0)
+
+
+def frame(cmd, payload=b''):
+    body = cmd + payload
+    return body + crc16(body).to_bytes(2, 'big')
+
+
+def read_hex(path):
+    """Intel HEX file to flash image, padded with 0xFF to whole pages"""
+    mem = {}
+    base = 0
+    with open(path) as f:
+        for num, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if not line.startswith(':'):
+                raise ValueError('%s:%d: not Intel HEX' % (path, num))
+            rec = bytes.fromhex(line[1:])
+            if sum(rec) & 0xFF:
+                raise ValueError('%s:%d: bad checksum' % (path, num))
+            count, addr, rtype, data = rec[0], (rec[1] << 8) | rec[2], rec[3], rec[4:-1]
+            if rtype == 0:
+                for i, b in enumerate(data[:count]):
+                    mem[base + addr + i] = b
+            elif rtype == 1:
+                break
+            elif rtype == 2:
+                base = ((data[0] << 8) | data[1]) << 4
+            elif rtype == 4:
+                base = ((data[0] << 8) | data[1]) << 16
+    if not mem:
+        raise ValueError('%s: no data' % path)
+    size = (max(mem) // PAGE_SIZE + 1) * PAGE_SIZE
+    image = bytearray(b'\xff' * size)
+    for addr, b in mem.items():
+        image[addr] = b
+    return image
+
+
+def pages(image):
+    return [bytes(image[i:i + PAGE_SIZE]) for i in range(0, len(image), PAGE_SIZE)]
+
+
+def sync(port):
+    """Fill any command the bootloader is part way into, then ask for its info"""
+    port.write(bytes(PAGE_SIZE + 3))  # 0 is not a command
+    port.flush()
+    time.sleep(0.05)
+    port.reset_input_buffer()
+    port.write(frame(CMD_SYNC))
+    reply = port.read(4)
+    if len(reply) == 4 and reply[:1] == CMD_SYNC:
+        return reply[1], reply[2], reply[3]
+    return None
+
+
+def enter(port, args):
+    body = 'U=boot'
+    line = (body + '*' + checksum(body) + '\n').encode('ascii')
+    end = time.time() + args.wait
+    while time.time() < end:
+        if args.enter == 'console':
+            port.baudrate = CONSOLE_BAUD
+            port.write(line)
+            port.flush()
+            time.sleep(0.05)  # Settings are saved before the jump
+            port.baudrate = args.baud
+        elif args.enter == 'break':
+            port.break_condition = True
+            time.sleep(args.break_time)
+            port.break_condition = False
+        info = sync(port)
+        if info:
+            return info
+        time.sleep(0.5)
+    return None
+
+
+def command(port, data, reply_len, timeout=2.0):
+    port.reset_input_buffer()
+    port.write(data)
+    port.timeout = timeout
+    reply = port.read(reply_len)
+    port.timeout = 0.5
+    return reply
+
+
+def read_hashes(port, app_pages):
+    reply = command(port, frame(CMD_HASH), 1 + 2 * app_pages)
+    if len(reply) != 1 + 2 * app_pages or reply[:1] != ACK:
+        raise IOError('no page hashes')
+    return [int.from_bytes(reply[1 + 2 * i:3 + 2 * i], 'big') for i in range(app_pages)]
+
+
+def write_page(port, num, data):
+    for _ in range(RETRIES):
+        if command(port, frame(CMD_WRITE, bytes([num]) + data), 1) == ACK:
+            return
+    raise IOError('page %d not written' % num)
+
+
+def update(port_name, image, args):
+    import serial  # pyserial
+    with serial.Serial(port_name, args.baud, timeout=0.5) as port:
+        print('%s: waiting for bootloader (%s)' % (port_name, args.enter))
+        info = enter(port, args)
+        if not info:
+            raise IOError('no bootloader')
+        page_size, app_pages, version = info
+        if page_size != PAGE_SIZE or version != BOOT_VERSION:
+            raise IOError('bootloader page size %d version %d not supported' % (page_size, version))
+        new = pages(image)
+        if len(new) > app_pages:
+            raise IOError('image of %d pages does not fit %d' % (len(new), app_pages))
+
+        hashes = read_hashes(port, app_pages)
+        changed = [i for i, p in enumerate(new) if crc16(p) != hashes[i]]
+        print('%s: %d of %d pages differ %s' % (port_name, len(changed), len(new),
+              ' '.join(str(i) for i in changed)))
+        if args.check:
+            return
+        if changed:
+            # Blank reset vector first and write it last: an update cut
+            # short leaves no application, so the bootloader stays
+            if hashes[0] != crc16(b'\xff' * PAGE_SIZE):
+                write_page(port, 0, b'\xff' * PAGE_SIZE)
+            for num in changed:
+                if num:
+                    write_page(port, num, new[num])
+                    sys.stdout.write('.')
+                    sys.stdout.flush()
+            write_page(port, 0, new[0])
+            print()
+            hashes = read_hashes(port, app_pages)
+            bad = [i for i, p in enumerate(new) if crc16(p) != hashes[i]]
+            if bad:
+                raise IOError('verify failed on pages %s' % ' '.join(str(i) for i in bad))
+        if command(port, frame(CMD_GO), 1) != ACK:
+            raise IOError('application did not start')
+        print('%s: done' % port_name)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Update Digital Clock firmware over serial')
+    ap.add_argument('hexfile', help='application image (main.hex)')
+    ap.add_argument('ports', nargs='+', help='serial ports of the clocks')
+    ap.add_argument('--baud', type=int, default=38400,
+                    help='bootloader baud rate, 9600 below 4MHz F_CPU (default 38400)')
+    ap.add_argument('--enter', choices=('console', 'break', 'none'), default='console',
+                    help='how to start the bootloader (default console)')
+    ap.add_argument('--break-time', type=float, default=3,
+                    help='seconds to hold break for --enter break (default 3)')
+    ap.add_argument('--wait', type=int, default=65,
+                    help='seconds to wait for the bootloader (default 65)')
+    ap.add_argument('--check', action='store_true', help='only list pages that differ')
+    args = ap.parse_args()
+
+    image = read_hex(args.hexfile)
+    failed = 0
+    for port_name in args.ports:
+        try:
+            update(port_name, image, args)
+        except IOError as e:
+            print('%s: %s' % (port_name, e), file=sys.stderr)
+            failed += 1
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""
+clock_sync.py
+
+Set the Digital Clock over its receive only serial console (RXD, 9600 8N1).
+Time and date are taken from this PC. The clock does not reply, so the
+command is sent once a second, on the second boundary, for a few seconds.
+The console listens for 10 seconds after boot and after each valid
+command, and for 2 seconds at the start of each minute otherwise: the
+line is sent for a little over a minute, or reset the clock meanwhile.
+
+  clock_sync.py /dev/ttyUSB0                   sync time and date
+  clock_sync.py /dev/ttyUSB0 --alarm 06:30     also set daily alarm
+  clock_sync.py /dev/ttyUSB0 --alarm off --brightness 1 --timer 00:25:00
+  clock_sync.py --print --no-time --alarm 07:00   print the line only
+  clock_sync.py /dev/ttyUSB0 --no-time --vbat 3987  calibrate fuel gauge
+  clock_sync.py /dev/ttyUSB0 --quiet 23-06     blank display 23:00 to 06:00
+
+To test under simavr, run the firmware with the uart pty enabled and pass
+the pty device (e.g. /tmp/simavr-uart0) as the port.
+"""
+
+import argparse
+import sys
+import time
+
+
+def checksum(body):
+    s = 0
+    for c in body.encode('ascii'):
+        s ^= c
+    return '%02X' % s
+
+
+def hhmm(text, fields):
+    parts = text.split(':')
+    if len(parts) != fields or not all(p.isdigit() for p in parts):
+        raise argparse.ArgumentTypeError('expected %s' % ':'.join(['NN'] * fields))
+    return ''.join('%02d' % int(p) for p in parts)
+
+
+def build_line(args, now):
+    fields = []
+    if not args.no_time:
+        fields.append(time.strftime('T=%H%M%S', now))
+        fields.append(time.strftime('D=%d%m%y', now))
+    if args.alarm:
+        fields.append('A=off' if args.alarm == 'off' else 'A=' + hhmm(args.alarm, 2))
+    if args.timer:
+        fields.append('C=' + hhmm(args.timer, 3))
+    if args.brightness is not None:
+        fields.append('B=%d' % args.brightness)
+    if args.format:
+        fields.append('F=%s' % args.format)
+    if args.vbat is not None:
+        fields.append('V=%04d' % args.vbat)
+    if args.quiet:
+        fields.append('Q=off' if args.quiet == 'off' else 'Q=' + hhmm(args.quiet.replace('-', ':'), 2))
+    body = ' '.join(fields)
+    return body + '*' + checksum(body) + '\n'
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Set Digital Clock over serial')
+    ap.add_argument('port', nargs='?', help='serial port of the clock')
+    ap.add_argument('--alarm', help='daily alarm HH:MM, or "off"')
+    ap.add_argument('--timer', help='start a countdown HH:MM:SS')
+    ap.add_argument('--brightness', type=int, choices=range(4))
+    ap.add_argument('--format', choices=('12', '24'), help='12 or 24 hour display')
+    ap.add_argument('--vbat', type=int, help='battery mV read by a multimeter, calibrates fuel gauge')
+    ap.add_argument('--quiet', help='quiet hours START-END (hours, display blanked), or "off"')
+    ap.add_argument('--no-time', action='store_true', help='do not set time and date')
+    ap.add_argument('--repeat', type=int, default=65,
+                    help='seconds to keep sending (default 65)')
+    ap.add_argument('--print', action='store_true', help='print command line and exit')
+    args = ap.parse_args()
+
+    if args.print:
+        sys.stdout.write(build_line(args, time.localtime()))
+        return 0
+    if not args.port:
+        ap.error('port is required')
+    if args.timer and args.repeat > 1:
+        print('note: --timer starts a new countdown for each line received, using --repeat 1')
+        args.repeat = 1
+
+    import serial  # pyserial
+    with serial.Serial(args.port, 9600) as port:
+        for _ in range(args.repeat):
+            time.sleep(1 - (time.time() % 1))  # Next second boundary
+            line = build_line(args, time.localtime())
+            port.write(line.encode('ascii'))
+            port.flush()
+            print(line.strip())
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""
+hist_decode.py
+
+Read the battery and temperature history of the Digital Clock and print
+it as CSV (time, battery volts, temperature degC).
+
+The history is dumped with the console command 'L=dump', as lines of
+"L=aaaa:<16 hex bytes>*HH". Either give the serial port, and the command
+is sent till the dump arrives (reset the clock to open its console window),
+or give a file holding captured dump lines ('-' for stdin).
+
+  hist_decode.py /dev/ttyUSB0 > unit1.csv
+  hist_decode.py dump.txt
+
+Block layout is described in history.c
+"""
+
+import argparse
+import datetime
+import re
+import sys
+import time
+
+BLOCK_SIZE = 32
+HDR_SIZE = 9
+EPOCH = datetime.datetime(2000, 1, 1)
+LINE = re.compile(r'L=([0-9A-F]{4}):([0-9A-F]{32})\*([0-9A-F]{2})')
+
+
+def checksum(body):
+    s = 0
+    for c in body.encode('ascii'):
+        s ^= c
+    return s
+
+
+def crc8(data):
+    """Dallas/Maxim CRC-8 as _crc_ibutton_update()"""
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8C if crc & 1 else crc >> 1
+    return crc
+
+
+def parse_lines(lines):
+    mem = {}
+    for line in lines:
+        m = LINE.search(line)
+        if not m:
+            continue
+        body = line[m.start():m.end() - 3]
+        if checksum(body) != int(m.group(3), 16):
+            print('bad checksum: ' + line.strip(), file=sys.stderr)
+            continue
+        mem[int(m.group(1), 16)] = bytes.fromhex(m.group(2))
+    if not mem:
+        return b''
+    start = min(mem)
+    return b''.join(mem.get(a, b'\xff' * 16) for a in range(start, max(mem) + 16, 16))
+
+
+def decode(data):
+    blocks = []
+    for off in range(0, len(data) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        blk = data[off:off + BLOCK_SIZE]
+        if crc8(blk[:HDR_SIZE - 1]) == blk[HDR_SIZE - 1]:
+            blocks.append(blk)
+    if not blocks:
+        return []
+    # Sequence numbers are 8 bit, order by age from the newest block
+    newest = blocks[0][0]
+    for blk in blocks:
+        if ((blk[0] - newest) & 0xFF) < 0x80:
+            newest = blk[0]
+    blocks.sort(key=lambda b: (newest - b[0]) & 0xFF, reverse=True)
+
+    samples = []
+    for blk in blocks:
+        interval = blk[4]
+        t = blk[1] | (blk[2] << 8) | (blk[3] << 16)
+        bat = blk[5] | (blk[6] << 8)
+        temp = blk[7] - 256 if blk[7] & 0x80 else blk[7]
+        samples.append((t * interval, bat, temp))
+        for d in blk[HDR_SIZE:]:
+            if d == 0xFF:
+                break
+            t += 1
+            bat += (d >> 4) - 8
+            temp += (d & 0xF) - 7
+            samples.append((t * interval, bat, temp))
+    return samples
+
+
+def read_port(port_name, timeout):
+    import serial  # pyserial
+    body = 'L=dump'
+    cmd = (body + '*%02X\n' % checksum(body)).encode('ascii')
+    lines = []
+    with serial.Serial(port_name, 9600, timeout=1) as port:
+        end = time.time() + timeout
+        while time.time() < end:
+            if not lines:
+                port.write(cmd)
+            line = port.readline().decode('ascii', 'replace')
+            if LINE.search(line):
+                lines.append(line)
+            elif lines:
+                break
+    return lines
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Decode Digital Clock history log')
+    ap.add_argument('source', help='serial port, or file of dump lines (- for stdin)')
+    ap.add_argument('--timeout', type=int, default=30,
+                    help='seconds to wait for a dump on serial port (default 30)')
+    args = ap.parse_args()
+
+    if args.source == '-':
+        lines = sys.stdin.readlines()
+    elif args.source.startswith('/dev/') or args.source.upper().startswith('COM'):
+        lines = read_port(args.source, args.timeout)
+    else:
+        with open(args.source) as f:
+            lines = f.readlines()
+
+    samples = decode(parse_lines(lines))
+    if not samples:
+        print('no history found', file=sys.stderr)
+        return 1
+    print('time,vbat,temp_c')
+    for minute, bat, temp in samples:
+        when = EPOCH + datetime.timedelta(minutes=minute)
+        print('%s,%.3f,%.1f' % (when.strftime('%Y-%m-%d %H:%M'), bat * 0.005, temp / 2))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
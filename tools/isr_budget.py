@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+isr_budget.py
+
+Worst case cycle count check for the interrupt handlers of the Digital Clock
+firmware. The longest path through each ISR is computed from the disassembly
+(avr-objdump -d) of the built ELF and compared with the ISR_BUDGET_<name>
+limits defined in main.c. Every handler in the vector table of the image
+needs a limit: one without is reported as an error.
+
+The handlers are required to be loop free: a path that comes back to an
+instruction on it is reported as an error since the bound would no longer hold
+(blocks placed out of order may still jump backward). Calls made from an ISR
+are followed and their own longest path is added.
+
+Usage: isr_budget.py main.elf [main.c]
+"""
+
+import re
+import subprocess
+import sys
+
+# ATmega8 interrupt vector numbers
+VECTORS = {
+    'INT0': 1, 'INT1': 2, 'TIMER2_COMP': 3, 'TIMER2_OVF': 4,
+    'TIMER1_CAPT': 5, 'TIMER1_COMPA': 6, 'TIMER1_COMPB': 7, 'TIMER1_OVF': 8,
+    'TIMER0_OVF': 9, 'SPI_STC': 10, 'USART_RXC': 11, 'USART_UDRE': 12,
+    'USART_TXC': 13, 'ADC': 14, 'EE_RDY': 15, 'ANA_COMP': 16, 'TWI': 17,
+    'SPM_RDY': 18,
+}
+
+# Interrupt response (4) + rjmp in the vector table (2)
+ENTRY_CYCLES = 6
+
+# Worst case cycles of the classic AVR core (ATmega8), branches taken
+CYCLES = {
+    'adiw': 2, 'sbiw': 2, 'mul': 2, 'muls': 2, 'mulsu': 2, 'fmul': 2,
+    'fmuls': 2, 'fmulsu': 2, 'ld': 2, 'ldd': 2, 'lds': 2, 'st': 2, 'std': 2,
+    'sts': 2, 'push': 2, 'pop': 2, 'sbi': 2, 'cbi': 2, 'rjmp': 2, 'ijmp': 2,
+    'jmp': 3, 'rcall': 3, 'icall': 3, 'call': 4, 'ret': 4, 'reti': 4,
+    'lpm': 3, 'spm': 4,
+}
+SKIPS = ('cpse', 'sbrc', 'sbrs', 'sbic', 'sbis')
+RETURNS = ('ret', 'reti')
+
+LINE_RE = re.compile(r'^\s*([0-9a-f]+):\s+((?:[0-9a-f]{2} )+)\s*(\S+)\s*(.*)$')
+FUNC_RE = re.compile(r'^([0-9a-f]+) <(\S+)>:$')
+TARGET_RE = re.compile(r';\s*0x([0-9a-f]+)')
+
+
+def disassemble(elf):
+    out = subprocess.run(['avr-objdump', '-d', elf], check=True,
+                         capture_output=True, text=True).stdout
+    insns = {}
+    funcs = {}
+    for line in out.splitlines():
+        m = FUNC_RE.match(line)
+        if m:
+            funcs[m.group(2)] = int(m.group(1), 16)
+            continue
+        m = LINE_RE.match(line)
+        if m:
+            addr = int(m.group(1), 16)
+            size = len(m.group(2).split())
+            t = TARGET_RE.search(m.group(4))
+            insns[addr] = (size, m.group(3), int(t.group(1), 16) if t else None)
+    return insns, funcs
+
+
+def longest(insns, addr, memo, calls, stack=()):
+    """Longest path in cycles from addr to a ret/reti"""
+    if addr in memo:
+        return memo[addr]
+    if addr in stack:
+        raise ValueError('loop at 0x%x' % addr)
+    if addr not in insns:
+        raise ValueError('no instruction at 0x%x' % addr)
+    size, op, target = insns[addr]
+    nxt = addr + size
+    stack = stack + (addr,)
+
+    if op in RETURNS:
+        cost = CYCLES[op]
+    elif op in ('rjmp', 'jmp'):
+        cost = CYCLES[op] + longest(insns, target, memo, calls, stack)
+    elif op in ('rcall', 'call'):
+        if target not in calls:
+            calls[target] = longest(insns, target, {}, calls)
+        cost = CYCLES[op] + calls[target] + longest(insns, nxt, memo, calls, stack)
+    elif op in ('ijmp', 'icall'):
+        raise ValueError('indirect jump at 0x%x' % addr)
+    elif op.startswith('br'):
+        cost = max(1 + longest(insns, nxt, memo, calls, stack),
+                   2 + longest(insns, target, memo, calls, stack))
+    elif op in SKIPS:
+        skipped = nxt + insns[nxt][0]
+        cost = max(1 + longest(insns, nxt, memo, calls, stack),
+                   1 + insns[nxt][0] // 2 + longest(insns, skipped, memo, calls, stack))
+    else:
+        cost = CYCLES.get(op, 1) + longest(insns, nxt, memo, calls, stack)
+
+    memo[addr] = cost
+    return cost
+
+
+def budgets(src):
+    text = open(src).read()
+    return {m.group(1): int(m.group(2)) for m in
+            re.finditer(r'#define\s+ISR_BUDGET_(\w+)\s+(\d+)', text)}
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip())
+        return 2
+    insns, funcs = disassemble(sys.argv[1])
+    limits = budgets(sys.argv[2] if len(sys.argv) > 2 else 'main.c')
+    names = {'__vector_%d' % n: name for name, n in VECTORS.items()}
+    calls = {}
+    failed = False
+    for vect in sorted(v for v in funcs if v in names):
+        if names[vect] not in limits:
+            print('%-14s ERROR no ISR_BUDGET_%s' % (names[vect], names[vect]))
+            failed = True
+    for name, limit in sorted(limits.items()):
+        vect = '__vector_%d' % VECTORS[name]
+        if vect not in funcs:
+            print('%-14s not present' % name)
+            continue
+        try:
+            cycles = ENTRY_CYCLES + longest(insns, funcs[vect], {}, calls)
+        except ValueError as e:
+            print('%-14s ERROR %s' % (name, e))
+            failed = True
+            continue
+        status = 'ok' if cycles <= limit else 'OVER'
+        failed |= cycles > limit
+        print('%-14s %4d / %4d cycles  %s' % (name, cycles, limit, status))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())